@@ -0,0 +1,284 @@
+/**
+ * @file alert.c
+ * @brief Application layer to raise alerts on thresholds of the samples
+ */
+
+#include "alert.h"
+#include "../mcal/timer.h"
+#include "storage.h"
+#include <avr/eeprom.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+
+/* Tells written rules apart from erased EEPROM and older layouts. */
+#define ALERT_RULES_MAGIC 0xA1
+
+#define ALERT_LOG_ACTIVE 0x80
+
+typedef struct {
+  uint8_t magic;
+  alert_rule_t rules[ALERT_RULES_NUM];
+} alert_stored_rules_t;
+
+/* NOTE: Entries are written in turn, the newest is the one the next entry
+ *       does not follow, by count. A torn entry fails its CRC.
+ */
+typedef struct {
+  uint8_t count;
+  uint8_t rule_state; /* rule, ALERT_LOG_ACTIVE if raised */
+  uint8_t value;
+  uint32_t epoch;
+  uint8_t crc;
+} alert_log_entry_t;
+
+typedef struct {
+  uint8_t b_active;
+  uint8_t b_pending; /* past the threshold, not for long enough yet */
+  uint8_t b_changed; /* by alert_set_rule, not evaluated since */
+  uint32_t since_ms;
+  alert_event_t event; /* of the last transition */
+} alert_state_t;
+
+_Static_assert(sizeof(alert_stored_rules_t) <= ALERT_RULES_SIZE_MAX,
+               "alert rules overflow their EEPROM area");
+_Static_assert(ALERT_LOG_ADDRESS + ALERT_LOG_NUM * sizeof(alert_log_entry_t) <=
+                   STORAGE_INTERNAL_EEPROM_SIZE,
+               "alert log overflows the internal EEPROM");
+
+static const alert_rule_t g_default_rules[ALERT_RULES_NUM] = {
+    {.metric = 0, .direction = ALERT_ABOVE, .threshold = 35, .hysteresis = 2,
+     .duration_s = 600},
+    {.metric = 1, .direction = ALERT_BELOW, .threshold = 25, .hysteresis = 3,
+     .duration_s = 600},
+    {.metric = ALERT_METRIC_NONE},
+    {.metric = ALERT_METRIC_NONE},
+};
+
+static alert_stored_rules_t g_stored;
+static volatile uint8_t gb_rules_dirty;
+static alert_state_t g_states[ALERT_RULES_NUM];
+static alert_log_entry_t g_log[ALERT_LOG_NUM]; /* as in the EEPROM */
+static uint8_t g_log_newest;
+static uint8_t g_log_length;
+static void (*gh_transition)(const alert_event_t *p_event);
+
+static uint8_t alert_log_crc(const alert_log_entry_t *p_entry) {
+  const uint8_t *p_byte = (const uint8_t *)p_entry;
+  uint8_t crc = 0xFF;
+  for (uint8_t i = 0; i < offsetof(alert_log_entry_t, crc); ++i) {
+    crc = _crc8_ccitt_update(crc, p_byte[i]);
+  }
+  return crc;
+}
+
+static uint8_t alert_log_is_valid(uint8_t slot) {
+  return g_log[slot].crc == alert_log_crc(&g_log[slot]);
+}
+
+static void alert_log_load(void) {
+  eeprom_read_block(g_log, (const void *)ALERT_LOG_ADDRESS, sizeof(g_log));
+  g_log_length = 0;
+  for (uint8_t slot = 0; slot < ALERT_LOG_NUM; ++slot) {
+    if (!alert_log_is_valid(slot)) {
+      continue;
+    }
+    ++g_log_length;
+    uint8_t next = (slot + 1) % ALERT_LOG_NUM;
+    if (!alert_log_is_valid(next) ||
+        g_log[next].count != (uint8_t)(g_log[slot].count + 1)) {
+      g_log_newest = slot;
+    }
+  }
+}
+
+static void alert_log_append(const alert_event_t *p_event) {
+  uint8_t slot = g_log_length ? (g_log_newest + 1) % ALERT_LOG_NUM : 0;
+  alert_log_entry_t entry = {
+      .count = g_log_length ? g_log[g_log_newest].count + 1 : 0,
+      .rule_state = p_event->rule | (p_event->b_active ? ALERT_LOG_ACTIVE : 0),
+      .value = p_event->value,
+      .epoch = p_event->epoch,
+  };
+  entry.crc = alert_log_crc(&entry);
+  eeprom_update_block(&entry, (void *)(ALERT_LOG_ADDRESS + slot *
+                                       sizeof(alert_log_entry_t)),
+                      sizeof(entry));
+  /* NOTE: The server reads the log from the receive interrupt. */
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    g_log[slot] = entry;
+    g_log_newest = slot;
+    if (g_log_length < ALERT_LOG_NUM) {
+      ++g_log_length;
+    }
+  }
+}
+
+static void alert_transition(uint8_t rule, uint8_t b_active, uint8_t value) {
+  alert_event_t event = {.rule = rule, .b_active = b_active, .value = value};
+  if (storage_get_epoch(&event.epoch) != STORAGE_OK) {
+    event.epoch = 0;
+  }
+  alert_log_append(&event);
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    g_states[rule].b_active = b_active;
+    g_states[rule].event = event;
+  }
+  if (gh_transition != NULL) {
+    gh_transition(&event);
+  }
+}
+
+static void alert_evaluate_rule(uint8_t rule, const uint8_t *p_data,
+                                uint32_t now_ms) {
+  alert_state_t *p_state = &g_states[rule];
+  alert_rule_t copy;
+  uint8_t b_changed;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    copy = g_stored.rules[rule];
+    b_changed = p_state->b_changed;
+    p_state->b_changed = 0;
+  }
+  if (b_changed) {
+    /* NOTE: A rule changed while raised clears, clients see it end. */
+    p_state->b_pending = 0;
+    if (p_state->b_active) {
+      alert_transition(rule, 0, p_state->event.value);
+    }
+  }
+  if (copy.metric >= ALERT_METRICS_NUM) {
+    return;
+  }
+
+  uint16_t value = p_data[copy.metric];
+  if (p_state->b_active) {
+    if (copy.direction == ALERT_ABOVE
+            ? value + copy.hysteresis <= copy.threshold
+            : value >= (uint16_t)copy.threshold + copy.hysteresis) {
+      alert_transition(rule, 0, value);
+    }
+    return;
+  }
+  if (copy.direction == ALERT_ABOVE ? value <= copy.threshold
+                                    : value >= copy.threshold) {
+    p_state->b_pending = 0;
+    return;
+  }
+  if (!p_state->b_pending) {
+    p_state->b_pending = 1;
+    p_state->since_ms = now_ms;
+  }
+  if (now_ms - p_state->since_ms >= copy.duration_s * 1000UL) {
+    p_state->b_pending = 0;
+    alert_transition(rule, 1, value);
+  }
+}
+
+/* -------- Interface Functions ---------- */
+alert_status_t alert_init(void (*h_transition)(const alert_event_t *p_event)) {
+  gh_transition = h_transition;
+  eeprom_read_block(&g_stored, (const void *)ALERT_RULES_ADDRESS,
+                    sizeof(g_stored));
+  if (g_stored.magic != ALERT_RULES_MAGIC) {
+    /* NOTE: Whatever is there is not ours, the log is wiped along. */
+    g_stored.magic = ALERT_RULES_MAGIC;
+    for (uint8_t rule = 0; rule < ALERT_RULES_NUM; ++rule) {
+      g_stored.rules[rule] = g_default_rules[rule];
+    }
+    eeprom_update_block(&g_stored, (void *)ALERT_RULES_ADDRESS,
+                        sizeof(g_stored));
+    for (uint16_t i = 0; i < sizeof(g_log); ++i) {
+      eeprom_update_byte((uint8_t *)ALERT_LOG_ADDRESS + i, 0xFF);
+    }
+  }
+  alert_log_load();
+  return ALERT_OK;
+}
+
+alert_status_t alert_evaluate(const uint8_t *p_data) {
+  uint32_t now_ms;
+  if (p_data == NULL || timer_get_ms(&now_ms) != TIMER_OK) {
+    return ALERT_ERROR;
+  }
+  for (uint8_t rule = 0; rule < ALERT_RULES_NUM; ++rule) {
+    alert_evaluate_rule(rule, p_data, now_ms);
+  }
+  return ALERT_OK;
+}
+
+alert_status_t alert_routine(void) {
+  if (!gb_rules_dirty) {
+    return ALERT_OK;
+  }
+  alert_stored_rules_t copy;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    copy = g_stored;
+    gb_rules_dirty = 0;
+  }
+  eeprom_update_block(&copy, (void *)ALERT_RULES_ADDRESS, sizeof(copy));
+  return ALERT_OK;
+}
+
+alert_status_t alert_get_rule(uint8_t rule, alert_rule_t *p_rule) {
+  if (rule >= ALERT_RULES_NUM || p_rule == NULL) {
+    return ALERT_ERROR;
+  }
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { *p_rule = g_stored.rules[rule]; }
+  return ALERT_OK;
+}
+
+alert_status_t alert_set_rule(uint8_t rule, const alert_rule_t *p_rule) {
+  if (rule >= ALERT_RULES_NUM || p_rule == NULL ||
+      (p_rule->metric >= ALERT_METRICS_NUM &&
+       p_rule->metric != ALERT_METRIC_NONE) ||
+      p_rule->direction > ALERT_BELOW) {
+    return ALERT_ERROR;
+  }
+  /* NOTE: The EEPROM is written from the main loop, an interrupt writing it
+   *       could garble a write of the main loop.
+   */
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    g_stored.rules[rule] = *p_rule;
+    g_states[rule].b_changed = 1;
+    gb_rules_dirty = 1;
+  }
+  return ALERT_OK;
+}
+
+alert_status_t alert_get_event(uint8_t index, alert_event_t *p_event) {
+  if (p_event == NULL) {
+    return ALERT_ERROR;
+  }
+  alert_log_entry_t entry;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    if (index < g_log_length) {
+      entry = g_log[(g_log_newest + ALERT_LOG_NUM - index) % ALERT_LOG_NUM];
+    }
+  }
+  if (index >= g_log_length) {
+    return ALERT_ERROR;
+  }
+  p_event->epoch = entry.epoch;
+  p_event->rule = entry.rule_state & ~ALERT_LOG_ACTIVE;
+  p_event->b_active = !!(entry.rule_state & ALERT_LOG_ACTIVE);
+  p_event->value = entry.value;
+  return ALERT_OK;
+}
+
+alert_status_t alert_get_active(alert_event_t *p_event) {
+  if (p_event == NULL) {
+    return ALERT_ERROR;
+  }
+  for (uint8_t rule = 0; rule < ALERT_RULES_NUM; ++rule) {
+    uint8_t b_active;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      b_active = g_states[rule].b_active;
+      *p_event = g_states[rule].event;
+    }
+    if (b_active) {
+      return ALERT_OK;
+    }
+  }
+  return ALERT_ERROR;
+}
@@ -0,0 +1,80 @@
+/**
+ * @file alert.h
+ * @brief Application layer to raise alerts on thresholds of the samples
+ *
+ * Every measured sample is evaluated against a small table of rules. A rule
+ * raises once its metric stayed past the threshold for a while, and clears
+ * once the metric went back past the threshold by the hysteresis, so that a
+ * reading hovering around the threshold does not flap. Transitions are kept
+ * in a log in the internal EEPROM after the fault record, along with the
+ * rules, and handed to a handler, e.g. to push them to clients.
+ */
+
+#ifndef ALERT_H
+#define ALERT_H
+
+#include "fault.h"
+#include <stdint.h>
+
+#define ALERT_RULES_NUM 4
+#define ALERT_LOG_NUM 6
+
+/* Metrics index the sample data: temperature, humidity and light. */
+#define ALERT_METRICS_NUM 3
+#define ALERT_METRIC_NONE 0xFF /* the rule is not in use */
+
+/* Records follow the fault record in the internal EEPROM. */
+#define ALERT_RULES_ADDRESS (FAULT_RECORD_ADDRESS + FAULT_RECORD_SIZE_MAX)
+#define ALERT_RULES_SIZE_MAX 32
+#define ALERT_LOG_ADDRESS (ALERT_RULES_ADDRESS + ALERT_RULES_SIZE_MAX)
+
+typedef enum : uint8_t {
+  ALERT_OK = 0,
+  ALERT_ERROR = 1,
+} alert_status_t;
+
+typedef enum : uint8_t {
+  ALERT_ABOVE = 0,
+  ALERT_BELOW = 1,
+} alert_direction_t;
+
+typedef struct {
+  uint8_t metric; /* or ALERT_METRIC_NONE */
+  alert_direction_t direction;
+  uint8_t threshold;
+  uint8_t hysteresis;  /* back past the threshold by that much clears */
+  uint16_t duration_s; /* past the threshold that long raises */
+} alert_rule_t;
+
+typedef struct {
+  uint32_t epoch; /* seconds since 2000-01-01 00:00:00 */
+  uint8_t rule;
+  uint8_t b_active; /* raised, or cleared */
+  uint8_t value;    /* reading that made the transition */
+} alert_event_t;
+
+/* Loads the rules and the log, h_transition is called on every transition
+ * from the main loop, it may be NULL.
+ */
+alert_status_t alert_init(void (*h_transition)(const alert_event_t *p_event));
+
+/* Evaluates a sample of ALERT_METRICS_NUM readings, call it from the
+ * sampling path, how often does not matter as durations are timed.
+ */
+alert_status_t alert_evaluate(const uint8_t *p_data);
+
+/* Stores rules changed by alert_set_rule(), call it from the main loop. */
+alert_status_t alert_routine(void);
+
+alert_status_t alert_get_rule(uint8_t rule, alert_rule_t *p_rule);
+
+/* Safe from interrupts, e.g. the server, takes effect on the next sample. */
+alert_status_t alert_set_rule(uint8_t rule, const alert_rule_t *p_rule);
+
+/* Index 0 is the newest transition logged. */
+alert_status_t alert_get_event(uint8_t index, alert_event_t *p_event);
+
+/* The raise of the lowest rule active, ALERT_ERROR when none is. */
+alert_status_t alert_get_active(alert_event_t *p_event);
+
+#endif /* ALERT_H */
@@ -0,0 +1,229 @@
+/**
+ * @file display.c
+ * @brief Application layer to show the latest sample and its trend on the LCD
+ *
+ * Row 0 holds the latest sample, row 1 its time, or the active alert, and
+ * rows 2 and 3 the temperature and humidity sparklines, oldest sample on
+ * the left.
+ */
+
+#include "display.h"
+#include "../hal/ds1307.h"
+#include "../hal/lcd.h"
+#include "alert.h"
+#include "server.h"
+#include "storage.h"
+#include <avr/pgmspace.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define DISPLAY_COLS_NUM 20
+
+typedef struct {
+  uint8_t temperature[DISPLAY_HISTORY_NUM];
+  uint8_t humidity[DISPLAY_HISTORY_NUM];
+  uint8_t length; /* newest at length - 1 */
+  server_entry_data_t latest;
+  uint32_t latest_epoch;
+} display_history_t;
+
+static display_history_t g_history;
+static uint16_t g_generation;
+static uint8_t gb_drawn;
+static uint8_t gb_status_shown;
+static char g_row_str[DISPLAY_COLS_NUM + 1];
+
+static void display_row(uint8_t row) {
+  /* NOTE: Rows are padded so that what was there before is cleared. */
+  uint8_t col = 0;
+  while (g_row_str[col]) {
+    ++col;
+  }
+  for (; col < DISPLAY_COLS_NUM; ++col) {
+    g_row_str[col] = ' ';
+  }
+  g_row_str[DISPLAY_COLS_NUM] = '\0';
+  lcd_locate_str(row, 0, g_row_str);
+}
+
+static void display_sparkline(uint8_t row, char label, const uint8_t *values) {
+  uint8_t min = UINT8_MAX, max = 0;
+  for (uint8_t i = 0; i < g_history.length; ++i) {
+    if (values[i] < min) {
+      min = values[i];
+    }
+    if (values[i] > max) {
+      max = values[i];
+    }
+  }
+  g_row_str[0] = label;
+  for (uint8_t i = 0; i < DISPLAY_HISTORY_NUM; ++i) {
+    /* Right aligned, so the newest sample is always in the last column. */
+    int8_t index = i - (DISPLAY_HISTORY_NUM - g_history.length);
+    uint8_t level = DISPLAY_BAR_LEVELS_NUM / 2 - 1;
+    if (index < 0) {
+      g_row_str[1 + i] = ' ';
+      continue;
+    }
+    if (max > min) {
+      level = (uint16_t)(values[index] - min) * (DISPLAY_BAR_LEVELS_NUM - 1) /
+              (max - min);
+    }
+    g_row_str[1 + i] = DISPLAY_BAR_CHAR_BASE + level;
+  }
+  g_row_str[DISPLAY_COLS_NUM] = '\0';
+  lcd_locate_str(row, 0, g_row_str);
+}
+
+/* Raised rule, its threshold and the time it was raised at, BCD as below. */
+static uint8_t display_alert_str(void) {
+  static const char metric_chars[] PROGMEM = "THL";
+  alert_event_t event;
+  alert_rule_t rule;
+  RTC_Time_t time;
+  if (alert_get_active(&event) != ALERT_OK ||
+      alert_get_rule(event.rule, &rule) != ALERT_OK ||
+      rule.metric >= ALERT_METRICS_NUM ||
+      RTC_fromEpoch(event.epoch, &time) != RTC_SUCCESS) {
+    return 0;
+  }
+  sprintf_P(g_row_str, PSTR("! ALERT %c%c%u %02x:%02x"),
+            pgm_read_byte(&metric_chars[rule.metric]),
+            rule.direction == ALERT_ABOVE ? '>' : '<', rule.threshold,
+            time.time.hours, time.time.minutes);
+  return 1;
+}
+
+static void display_time(void) {
+  RTC_Time_t time;
+  /* NOTE: An active alert matters more than the time of the sample. */
+  if (display_alert_str()) {
+    display_row(1);
+    return;
+  }
+  if (g_history.length == 0 ||
+      RTC_fromEpoch(g_history.latest_epoch, &time) != RTC_SUCCESS) {
+    g_row_str[0] = '\0';
+  } else {
+    /* NOTE: RTC fields are BCD, so hex prints their decimal digits. */
+    sprintf_P(g_row_str, PSTR("20%02x-%02x-%02x %02x:%02x"), time.time.year,
+              time.time.month, time.time.dayOfMonth, time.time.hours,
+              time.time.minutes);
+  }
+  display_row(1);
+}
+
+static void display_draw(void) {
+  if (g_history.length == 0) {
+    sprintf_P(g_row_str, PSTR("T --C  H --%%  L ---"));
+  } else {
+    sprintf_P(g_row_str, PSTR("T %2uC  H %2u%%  L %3u"),
+              g_history.latest.as_struct.temperature,
+              g_history.latest.as_struct.humidity,
+              g_history.latest.as_struct.light);
+  }
+  display_row(0);
+  if (!gb_status_shown) {
+    display_time();
+  }
+  display_sparkline(2, 'T', g_history.temperature);
+  display_sparkline(3, 'H', g_history.humidity);
+}
+
+static void display_push(const server_entry_data_t *p_data, uint32_t epoch) {
+  if (g_history.length == DISPLAY_HISTORY_NUM) {
+    for (uint8_t i = 1; i < DISPLAY_HISTORY_NUM; ++i) {
+      g_history.temperature[i - 1] = g_history.temperature[i];
+      g_history.humidity[i - 1] = g_history.humidity[i];
+    }
+    --g_history.length;
+  }
+  g_history.temperature[g_history.length] = p_data->as_struct.temperature;
+  g_history.humidity[g_history.length] = p_data->as_struct.humidity;
+  ++g_history.length;
+  g_history.latest = *p_data;
+  g_history.latest_epoch = epoch;
+}
+
+/* Refills the history from storage, oldest first. */
+static void display_reload(void) {
+  uint16_t length;
+  server_entry_data_t data;
+  storage_stamp_t stamp;
+  g_history.length = 0;
+  if (storage_get_length(&length) != STORAGE_OK) {
+    return;
+  }
+  if (length > DISPLAY_HISTORY_NUM) {
+    length = DISPLAY_HISTORY_NUM;
+  }
+  while (length--) {
+    if (storage_get_block(length, data.as_array, &stamp) == STORAGE_OK) {
+      display_push(&data, stamp.epoch);
+    }
+  }
+}
+
+/* -------- Interface Functions ---------- */
+display_status_t display_init(void) {
+  uint8_t dot_matrix[8];
+  for (uint8_t level = 0; level < DISPLAY_BAR_LEVELS_NUM; ++level) {
+    for (uint8_t row = 0; row < 8; ++row) {
+      dot_matrix[row] = row >= 7 - level ? 0x1F : 0x00;
+    }
+    if (lcd_custom_char(level, dot_matrix) != LCD_OK) {
+      return DISPLAY_ERROR;
+    }
+  }
+  storage_get_generation(&g_generation);
+  display_reload();
+  display_draw();
+  gb_drawn = 1;
+  return DISPLAY_OK;
+}
+
+display_status_t display_routine(void) {
+  uint16_t generation;
+  if (!gb_drawn || storage_get_generation(&generation) != STORAGE_OK ||
+      generation == g_generation) {
+    return DISPLAY_OK;
+  }
+
+  /* NOTE: One new sample is shifted in, anything else, e.g. a format or
+   *       samples missed, reloads the whole history.
+   */
+  server_entry_data_t data;
+  storage_stamp_t stamp;
+  if ((uint16_t)(generation - g_generation) == 1 &&
+      storage_get_block(0, data.as_array, &stamp) == STORAGE_OK) {
+    display_push(&data, stamp.epoch);
+  } else {
+    display_reload();
+  }
+  g_generation = generation;
+  gb_status_shown = 0;
+  display_draw();
+  return DISPLAY_OK;
+}
+
+display_status_t display_alert(void) {
+  if (!gb_drawn) {
+    return DISPLAY_ERROR;
+  }
+  /* NOTE: A status stays until the next sample, as it would otherwise. */
+  if (!gb_status_shown) {
+    display_time();
+  }
+  return DISPLAY_OK;
+}
+
+display_status_t display_status_P(const char *str_P) {
+  if (str_P == NULL) {
+    return DISPLAY_ERROR;
+  }
+  snprintf_P(g_row_str, sizeof(g_row_str), PSTR("! %S"), str_P);
+  display_row(1);
+  gb_status_shown = 1;
+  return DISPLAY_OK;
+}
@@ -0,0 +1,39 @@
+/**
+ * @file display.h
+ * @brief Application layer to show the latest sample and its trend on the LCD
+ */
+
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <stdint.h>
+
+/* Samples a sparkline row shows, one per cell after its label. */
+#define DISPLAY_HISTORY_NUM 19
+
+/* NOTE: CGRAM codes 8 to 15 show the custom chars 0 to 7, bars use them so
+ *       that none of them is the NUL ending a string.
+ */
+#define DISPLAY_BAR_CHAR_BASE 8
+#define DISPLAY_BAR_LEVELS_NUM 8
+
+typedef enum : uint8_t {
+  DISPLAY_OK = 0,
+  DISPLAY_ERROR = 1,
+} display_status_t;
+
+display_status_t display_init(void);
+
+/* Redraws when a sample was stored, only the cells that change are sent. */
+display_status_t display_routine(void);
+
+/* Redraws the alert row, call it when an alert is raised or cleared. */
+display_status_t display_alert(void);
+
+/* Shows a status on row 1 in place of the sample's time or the active alert,
+ * until the next sample is drawn. The string is in flash, e.g.
+ * PSTR("sensor failure").
+ */
+display_status_t display_status_P(const char *str_P);
+
+#endif /* DISPLAY_H */
@@ -0,0 +1,176 @@
+/**
+ * @file fault.c
+ * @brief Application layer to supervise the station and recover from faults
+ */
+
+#include "fault.h"
+#include "../mcal/timer.h"
+#include "storage.h"
+#include <avr/eeprom.h>
+#include <avr/io.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <util/crc16.h>
+
+/* Tells a written record apart from erased EEPROM. */
+#define FAULT_RECORD_MAGIC 0x5A
+
+typedef struct {
+  uint8_t magic;
+  fault_record_t record;
+} fault_stored_record_t;
+
+_Static_assert(sizeof(fault_stored_record_t) <= FAULT_RECORD_SIZE_MAX,
+               "fault record overflows its EEPROM area");
+
+typedef struct {
+  fault_status_t (*h_restart)(void);
+  fault_status_t (*h_probe)(void);
+  uint8_t failed_restarts; /* in a row */
+} fault_subsystem_slot_t;
+
+/* NOTE: Kept through resets that leave SRAM alone, with the counts not
+ *       stored yet. The check tells it apart from SRAM after a power-up.
+ */
+static fault_stored_record_t g_stored __attribute__((section(".noinit")));
+static uint8_t g_stored_check __attribute__((section(".noinit")));
+static fault_subsystem_slot_t g_subsystems[FAULT_SUBSYSTEMS_NUM];
+static uint32_t g_probe_ms;
+static uint32_t g_store_ms;
+static uint8_t gb_store_pending;
+
+/* MCUCSR as it was at reset, saved before main() runs. */
+static uint8_t g_mcucsr __attribute__((section(".noinit")));
+
+void fault_save_mcucsr(void) __attribute__((naked, used, section(".init3")));
+void fault_save_mcucsr(void) {
+  g_mcucsr = MCUCSR;
+  MCUCSR = 0;
+  /* NOTE: A watchdog reset may leave the watchdog running through init. */
+  wdt_disable();
+}
+
+static uint8_t fault_get_check(void) {
+  const uint8_t *p_byte = (const uint8_t *)&g_stored;
+  uint8_t crc = 0;
+  for (uint8_t i = 0; i < sizeof(g_stored); ++i) {
+    crc = _crc8_ccitt_update(crc, p_byte[i]);
+  }
+  return crc;
+}
+
+static void fault_store(void) {
+  eeprom_update_block(&g_stored, (void *)FAULT_RECORD_ADDRESS,
+                      sizeof(g_stored));
+  gb_store_pending = 0;
+  timer_get_ms(&g_store_ms);
+}
+
+/* -------- Interface Functions ---------- */
+fault_status_t fault_init(void) {
+  if ((g_mcucsr & (1 << FAULT_RESET_POWER_ON | 1 << FAULT_RESET_BROWN_OUT)) ||
+      g_stored.magic != FAULT_RECORD_MAGIC ||
+      g_stored_check != fault_get_check()) {
+    eeprom_read_block(&g_stored, (const void *)FAULT_RECORD_ADDRESS,
+                      sizeof(g_stored));
+  }
+  if (g_stored.magic != FAULT_RECORD_MAGIC) {
+    g_stored = (fault_stored_record_t){.magic = FAULT_RECORD_MAGIC};
+  }
+  g_stored.record.last_reset_causes = g_mcucsr;
+  for (uint8_t cause = 0; cause < FAULT_RESET_CAUSES_NUM; ++cause) {
+    if (g_mcucsr & (1 << cause)) {
+      ++g_stored.record.resets[cause];
+    }
+  }
+  g_stored_check = fault_get_check();
+  /* NOTE: Stored once up for a store period, a station rebooting faster than
+   *       that keeps counting in SRAM rather than wear the record out.
+   */
+  gb_store_pending = 1;
+
+  timer_get_ms(&g_probe_ms);
+  g_store_ms = g_probe_ms;
+  wdt_enable(FAULT_WDT_TIMEOUT);
+  return FAULT_OK;
+}
+
+fault_status_t fault_register(fault_subsystem_t subsystem,
+                              fault_status_t (*h_restart)(void),
+                              fault_status_t (*h_probe)(void)) {
+  if (subsystem >= FAULT_SUBSYSTEMS_NUM || h_restart == NULL) {
+    return FAULT_ERROR;
+  }
+  g_subsystems[subsystem].h_restart = h_restart;
+  g_subsystems[subsystem].h_probe = h_probe;
+  return FAULT_OK;
+}
+
+fault_status_t fault_feed(void) {
+  wdt_reset();
+  return FAULT_OK;
+}
+
+fault_status_t fault_routine(void) {
+  uint32_t now_ms;
+  fault_feed();
+  if (timer_get_ms(&now_ms) != TIMER_OK ||
+      now_ms - g_probe_ms < FAULT_PROBE_PERIOD_MS) {
+    return FAULT_OK;
+  }
+  g_probe_ms = now_ms;
+  if (gb_store_pending && now_ms - g_store_ms >= FAULT_STORE_PERIOD_MS) {
+    fault_store();
+  }
+
+  fault_status_t status = FAULT_OK;
+  for (uint8_t subsystem = 0; subsystem < FAULT_SUBSYSTEMS_NUM; ++subsystem) {
+    fault_subsystem_slot_t *p_slot = &g_subsystems[subsystem];
+    if (p_slot->h_probe != NULL && p_slot->h_probe() != FAULT_OK &&
+        fault_restart(subsystem) != FAULT_OK) {
+      status = FAULT_ERROR;
+    }
+  }
+  return status;
+}
+
+fault_status_t fault_restart(fault_subsystem_t subsystem) {
+  if (subsystem >= FAULT_SUBSYSTEMS_NUM ||
+      g_subsystems[subsystem].h_restart == NULL) {
+    return FAULT_ERROR;
+  }
+  fault_subsystem_slot_t *p_slot = &g_subsystems[subsystem];
+  ++g_stored.record.restarts[subsystem];
+  g_stored_check = fault_get_check();
+  gb_store_pending = 1;
+
+  fault_feed();
+  if (p_slot->h_restart() == FAULT_OK) {
+    p_slot->failed_restarts = 0;
+    return FAULT_OK;
+  }
+  /* NOTE: A subsystem that cannot be restarted on its own may still come
+   *       back with the whole MCU.
+   */
+  if ((FAULT_ESCALATE_MASK & (1 << subsystem)) &&
+      ++p_slot->failed_restarts >= FAULT_RESTARTS_MAX) {
+    fault_reset();
+  }
+  return FAULT_ERROR;
+}
+
+void fault_reset(void) {
+  storage_flush(); // staged samples would be lost on the reset
+  wdt_enable(WDTO_15MS);
+  while (1) {
+    /* Waiting for the watchdog */
+  }
+}
+
+fault_status_t fault_get_record(fault_record_t *p_record) {
+  if (p_record == NULL) {
+    return FAULT_ERROR;
+  }
+  *p_record = g_stored.record;
+  return FAULT_OK;
+}
@@ -0,0 +1,80 @@
+/**
+ * @file fault.h
+ * @brief Application layer to supervise the station and recover from faults
+ *
+ * The watchdog resets the MCU when the main loop stops feeding it, while
+ * subsystems that fail their probe are restarted on their own. Reset causes
+ * and restarts are counted in a record kept in the internal EEPROM.
+ */
+
+#ifndef FAULT_H
+#define FAULT_H
+
+#include "storage_backend.h"
+#include <avr/wdt.h>
+#include <stdint.h>
+
+/* The longest the ATmega32 watchdog waits, nothing may block that long. */
+#define FAULT_WDT_TIMEOUT WDTO_2S
+
+#define FAULT_PROBE_PERIOD_MS 60000UL
+
+/* Resets and restarts are counted in RAM and stored at most that often, as
+ * a subsystem that stays dead is restarted every probe period. The counts
+ * survive resets other than power-on and brown-out in RAM, only a power cut
+ * loses the ones not stored yet.
+ */
+#define FAULT_STORE_PERIOD_MS 3600000UL
+
+/* Failed restarts in a row before the whole MCU is reset instead. */
+#define FAULT_RESTARTS_MAX 5
+
+/* Fault record at the start of the area reserved in the internal EEPROM,
+ * the records of other modules follow it.
+ */
+#define FAULT_RECORD_ADDRESS STORAGE_INTERNAL_RESERVED_ADDRESS
+#define FAULT_RECORD_SIZE_MAX 32
+
+typedef enum : uint8_t {
+  FAULT_OK = 0,
+  FAULT_ERROR = 1,
+} fault_status_t;
+
+typedef enum : uint8_t {
+  FAULT_SUBSYSTEM_ESP01 = 0,
+  FAULT_SUBSYSTEM_TWI,
+  FAULT_SUBSYSTEMS_NUM,
+} fault_subsystem_t;
+
+/* Subsystems that resetting the MCU may bring back. The ESP-01 keeps its
+ * power through a reset of the MCU, so that would not help it.
+ */
+#define FAULT_ESCALATE_MASK (1 << FAULT_SUBSYSTEM_TWI)
+
+/* Bits of MCUCSR. */
+typedef enum : uint8_t {
+  FAULT_RESET_POWER_ON = 0,
+  FAULT_RESET_EXTERNAL,
+  FAULT_RESET_BROWN_OUT,
+  FAULT_RESET_WATCHDOG,
+  FAULT_RESET_JTAG,
+  FAULT_RESET_CAUSES_NUM,
+} fault_reset_cause_t;
+
+typedef struct {
+  uint8_t last_reset_causes; /* MCUCSR at the last reset */
+  uint16_t resets[FAULT_RESET_CAUSES_NUM];
+  uint16_t restarts[FAULT_SUBSYSTEMS_NUM];
+} fault_record_t;
+
+fault_status_t fault_init(void);
+fault_status_t fault_register(fault_subsystem_t subsystem,
+                              fault_status_t (*h_restart)(void),
+                              fault_status_t (*h_probe)(void));
+fault_status_t fault_routine(void);
+fault_status_t fault_feed(void);
+fault_status_t fault_restart(fault_subsystem_t subsystem);
+void fault_reset(void) __attribute__((noreturn));
+fault_status_t fault_get_record(fault_record_t *p_record);
+
+#endif /* FAULT_H */
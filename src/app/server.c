@@ -7,69 +7,687 @@
 
 #include "server.h"
 #include "../hal/esp01.h"
+#include "../mcal/profile.h"
+#include "fault.h"
 #include "storage.h"
+#include <avr/pgmspace.h>
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <util/atomic.h>
 
 #define B_INDEXED 0
 
-static void (*gh_get_entry)(uint8_t index, server_entry_t *p_entry);
-static char g_json_str[180];
+/* Newest entries kept pre-rendered, indices 0 up to SERVER_CACHE_SLOTS - 1,
+ * e.g. for {"latest": 1} polls.
+ */
+#define SERVER_CACHE_SLOTS 1
+#define SERVER_JSON_STR_SIZE 180
+
+/* Longest rendered entry: seq of 8 digits, timestamp of 10 and data of 3. */
+#define SERVER_ENTRY_STR_SIZE 94
+
+/* Packed records sent per packed request, newest first. */
+#define SERVER_PACKED_RECORDS_NUM 8
+
+/* Blocks a query request scans at most, which bounds the time spent in the
+ * receive interrupt. The response tells where to continue from.
+ */
+#define SERVER_QUERY_SCAN_MAX 256
+
+_Static_assert(STORAGE_SEQ_BITS <= 24,
+               "SERVER_ENTRY_STR_SIZE cannot hold seqs of more than 8 digits");
+
+_Static_assert(SERVER_PACKED_RECORDS_NUM * STORAGE_RECORD_SIZE * 2 + 30 <=
+                   SERVER_JSON_STR_SIZE,
+               "SERVER_JSON_STR_SIZE cannot hold the packed records");
+
+typedef struct {
+  uint16_t generation;
+  uint8_t b_valid;
+  char json_str[SERVER_ENTRY_STR_SIZE];
+} server_cache_slot_t;
+
+static server_status_t (*gh_get_entry)(uint16_t index,
+                                       server_entry_t *p_entry);
+static char g_json_str[SERVER_JSON_STR_SIZE];
 static server_entry_t g_entry;
+static server_cache_slot_t g_cache[SERVER_CACHE_SLOTS];
+static volatile uint8_t g_since_link_mask;
+static volatile uint8_t g_subscribe_link_mask;
+static const server_entry_data_t *gp_live_data;
+static const alert_event_t *gp_alert_event;
+
+/* Letters of the metrics in requests and frames, in the order of the data. */
+static const char g_metric_chars[] PROGMEM = "thl";
+static uint8_t gb_running;
+
+/* Constant responses are kept in flash and copied out when sent. */
+static const char *server_str_P(const char *str_P) {
+  strcpy_P(g_json_str, str_P);
+  return g_json_str;
+}
+
+static server_status_t server_render_entry(uint16_t index, char *json_str) {
+  if (gh_get_entry(index, &g_entry) != SERVER_OK) {
+    strcpy_P(json_str, PSTR("{}"));
+    return SERVER_ERROR;
+  }
+  sprintf_P(json_str,
+            PSTR("{\"seq\":%" PRIu32 ",\"timestamp\":%" PRIu32 ","
+                 "\"data\":{\"temperature\":%d,\"humidity\":%d,"
+                 "\"light\":%d}}"),
+            g_entry.seq, g_entry.timestamp,
+            g_entry.data.as_struct.temperature,
+            g_entry.data.as_struct.humidity, g_entry.data.as_struct.light);
+  return SERVER_OK;
+}
+
+static const char *server_index_str(uint16_t index) {
+  if (index < SERVER_CACHE_SLOTS) {
+    /* NOTE: Entries only change when a block is enqueued, so a slot rendered
+     *       at the current generation can be sent as is.
+     */
+    server_cache_slot_t *p_slot = &g_cache[index];
+    uint16_t generation;
+    storage_get_generation(&generation);
+    if (!p_slot->b_valid || p_slot->generation != generation) {
+      /* NOTE: A failure, e.g. STORAGE_BUSY during a flush, is not cached. */
+      p_slot->b_valid =
+          server_render_entry(index, p_slot->json_str) == SERVER_OK;
+      p_slot->generation = generation;
+    }
+    return p_slot->json_str;
+  }
+  server_render_entry(index, g_json_str);
+  return g_json_str;
+}
+
+static const char *server_latest_str(void) { return server_index_str(0); }
+
+/* Compact frame pushed to subscribers for each stored sample, its seq is
+ * what a since request resumes from.
+ */
+static const char *server_sample_frame_str(void) {
+  if (gh_get_entry(0, &g_entry) != SERVER_OK) {
+    return "";
+  }
+  sprintf_P(g_json_str,
+            PSTR("{\"seq\":%" PRIu32 ",\"ts\":%" PRIu32 ",\"t\":%d,"
+                 "\"h\":%d,\"l\":%d}"),
+            g_entry.seq, g_entry.timestamp,
+            g_entry.data.as_struct.temperature,
+            g_entry.data.as_struct.humidity, g_entry.data.as_struct.light);
+  return g_json_str;
+}
+
+/* Compact frame pushed to subscribers for a reading that is not stored. */
+static const char *server_live_frame_str(void) {
+  sprintf_P(g_json_str, PSTR("{\"t\":%d,\"h\":%d,\"l\":%d}"),
+            gp_live_data->as_struct.temperature,
+            gp_live_data->as_struct.humidity, gp_live_data->as_struct.light);
+  return g_json_str;
+}
+
+/* Frame pushed to subscribers on an alert transition. */
+static const char *server_alert_frame_str(void) {
+  sprintf_P(g_json_str,
+            PSTR("{\"alert\":%u,\"active\":%u,\"value\":%u,\"ts\":%" PRIu32
+                 "}"),
+            gp_alert_event->rule, gp_alert_event->b_active,
+            gp_alert_event->value, gp_alert_event->epoch);
+  return g_json_str;
+}
+
+/* Pushes to one link at a time, a CIPSEND round trip each, so that the
+ * watchdog is fed in between. Returns the links that failed.
+ */
+static uint8_t server_push_links(uint8_t link_mask,
+                                 const char *(*h_message)(void)) {
+  uint8_t failed_mask = 0;
+  for (uint8_t id = 0; id < ESP01_LINKS_NUM; ++id) {
+    uint8_t link_bit = 1 << id;
+    if (!(link_mask & link_bit)) {
+      continue;
+    }
+    fault_feed();
+    if (esp01_push(link_bit, h_message, NULL) != ESP01_OK) {
+      failed_mask |= link_bit;
+    }
+  }
+  return failed_mask;
+}
+
+static void server_push_subscribers(const char *(*h_frame)(void)) {
+  uint8_t failed_mask = server_push_links(g_subscribe_link_mask, h_frame);
+  /* NOTE: Links that cannot be sent to are gone, drop their subscription. */
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { g_subscribe_link_mask &= ~failed_mask; }
+}
+
+/* Layout a client needs to decode packed records: field widths in bits, seq
+ * and time first, and the time resolution in seconds.
+ */
+static const char *server_layout_str(void) {
+  static const uint8_t bits[] PROGMEM = {
+      STORAGE_SEQ_BITS, STORAGE_TIME_BITS,
+      STORAGE_DATA_FIELDS(STORAGE_FIELD_BITS_ENTRY)};
+  char *str = g_json_str;
+  str += sprintf_P(str, PSTR("{\"bits\":["));
+  for (uint8_t i = 0; i < sizeof(bits); ++i) {
+    str += sprintf_P(str, i ? PSTR(",%u") : PSTR("%u"),
+                     pgm_read_byte(&bits[i]));
+  }
+  sprintf_P(str, PSTR("],\"res\":%u}"), STORAGE_TIME_RESOLUTION_S);
+  return g_json_str;
+}
+
+/* Consecutive packed records from index on, hex encoded. */
+static const char *server_packed_str(uint16_t index) {
+  uint8_t record[STORAGE_RECORD_SIZE];
+  char *str = g_json_str;
+  str += sprintf_P(str, PSTR("{\"packed\":\""));
+  for (uint8_t i = 0; i < SERVER_PACKED_RECORDS_NUM &&
+                      storage_get_record(index + i, record) == STORAGE_OK;
+       ++i) {
+    for (uint8_t j = 0; j < STORAGE_RECORD_SIZE; ++j) {
+      str += sprintf_P(str, PSTR("%02x"), record[j]);
+    }
+  }
+  strcpy_P(str, PSTR("\"}"));
+  return g_json_str;
+}
 
-static uint8_t bcd_to_uint8(uint8_t bcd) {
-  return (bcd >> 4) * 10 + (bcd & 0x0F);
+/* Condition of a query request, e.g. "t>35": metric t, h or l as in the
+ * frames, operator <, <=, >, >=, = or != and a threshold.
+ */
+static server_status_t server_get_query(const char *metric_str,
+                                        const char *op_str, uint8_t threshold,
+                                        uint32_t after_epoch,
+                                        storage_query_t *p_query) {
+  /* NOTE: Both tables follow the order of their enum. */
+  static const char ops[][3] PROGMEM = {"<", "<=", ">", ">=", "=", "!="};
+  const char *p_metric = strchr_P(g_metric_chars, metric_str[0]);
+  if (p_metric == NULL) {
+    return SERVER_ERROR;
+  }
+  for (uint8_t op = 0; op < sizeof(ops) / sizeof(ops[0]); ++op) {
+    if (strcmp_P(op_str, ops[op]) == 0) {
+      p_query->field = p_metric - g_metric_chars;
+      p_query->op = op;
+      p_query->threshold = threshold;
+      p_query->after_epoch = after_epoch;
+      return SERVER_OK;
+    }
+  }
+  return SERVER_ERROR;
+}
+
+/* Queries are resumed by seq, as indices shift with every new sample. A seq
+ * out of reach, e.g. overwritten since, is past the oldest block.
+ */
+static server_status_t server_get_query_start(uint8_t b_from, uint32_t from_seq,
+                                              uint32_t *p_newest_seq,
+                                              uint16_t *p_index) {
+  uint16_t length;
+  if (storage_get_length(&length) != STORAGE_OK) {
+    return SERVER_ERROR;
+  }
+  *p_newest_seq = 0;
+  *p_index = 0;
+  if (length == 0) {
+    return SERVER_OK;
+  }
+  if (gh_get_entry(0, &g_entry) != SERVER_OK) {
+    return SERVER_ERROR;
+  }
+  *p_newest_seq = g_entry.seq;
+  if (b_from) {
+    uint32_t distance = (g_entry.seq - from_seq) & STORAGE_SEQ_MASK;
+    *p_index = distance < length ? distance : length;
+  }
+  return SERVER_OK;
+}
+
+/* Appends the seq the client continues a query from, if it is not done. */
+static void server_query_next_str(char *str,
+                                  const storage_query_result_t *p_result,
+                                  uint32_t newest_seq) {
+  if (p_result->b_done) {
+    strcpy_P(str, PSTR("}"));
+  } else {
+    sprintf_P(str, PSTR(",\"next\":%" PRIu32 "}"),
+              (newest_seq - p_result->next_index) & STORAGE_SEQ_MASK);
+  }
 }
 
-static const char *gh_response_str(const char *request_json_str) {
-  uint8_t index;
+/* Number of matches, and the stamps of the oldest and the newest of them. */
+static const char *server_count_str(const storage_query_t *p_query,
+                                    uint16_t index, uint32_t newest_seq) {
+  storage_query_result_t result;
+  if (storage_query(p_query, index, SERVER_QUERY_SCAN_MAX, 0, &result) ==
+      STORAGE_ERROR) {
+    return server_str_P(PSTR("{}"));
+  }
+  server_entry_t first, last;
+  if (result.count > 0 &&
+      (gh_get_entry(result.oldest_index, &first) != SERVER_OK ||
+       gh_get_entry(result.newest_index, &last) != SERVER_OK)) {
+    /* NOTE: A stamp could not be read, e.g. during a flush. Nothing is
+     *       counted and the client retries from where it started, as the
+     *       count cannot be split at a match.
+     */
+    sprintf_P(g_json_str, PSTR("{\"count\":0,\"next\":%" PRIu32 "}"),
+              (newest_seq - index) & STORAGE_SEQ_MASK);
+    return g_json_str;
+  }
+  char *str = g_json_str;
+  str += sprintf_P(str, PSTR("{\"count\":%u"), result.count);
+  if (result.count > 0) {
+    str += sprintf_P(str,
+                     PSTR(",\"first\":{\"seq\":%" PRIu32 ",\"ts\":%" PRIu32
+                          "},\"last\":{\"seq\":%" PRIu32 ",\"ts\":%" PRIu32
+                          "}"),
+                     first.seq, first.timestamp, last.seq, last.timestamp);
+  }
+  server_query_next_str(str, &result, newest_seq);
+  return g_json_str;
+}
+
+/* Packed records of the matches from index on, newest first, decoded as the
+ * ones of a packed request.
+ */
+static const char *server_match_str(const storage_query_t *p_query,
+                                    uint16_t index, uint32_t newest_seq) {
+  uint8_t record[STORAGE_RECORD_SIZE];
+  uint16_t scan_max = SERVER_QUERY_SCAN_MAX;
+  storage_query_result_t result = {.next_index = index, .b_done = false};
+  char *str = g_json_str;
+  str += sprintf_P(str, PSTR("{\"packed\":\""));
+  for (uint8_t i = 0; i < SERVER_PACKED_RECORDS_NUM && !result.b_done; ++i) {
+    /* NOTE: One match per scan, so that the record is read right away. */
+    uint16_t start = result.next_index;
+    if (storage_query(p_query, start, scan_max, 1, &result) != STORAGE_OK ||
+        result.count == 0) {
+      break;
+    }
+    if (storage_get_record(result.newest_index, record) != STORAGE_OK) {
+      /* The client retries from the match. */
+      result.next_index = result.newest_index;
+      result.b_done = false;
+      break;
+    }
+    scan_max -= result.next_index - start;
+    for (uint8_t j = 0; j < STORAGE_RECORD_SIZE; ++j) {
+      str += sprintf_P(str, PSTR("%02x"), record[j]);
+    }
+  }
+  str += sprintf_P(str, PSTR("\""));
+  server_query_next_str(str, &result, newest_seq);
+  return g_json_str;
+}
+
+static const char *server_rule_str(uint8_t rule) {
+  alert_rule_t copy;
+  if (alert_get_rule(rule, &copy) != ALERT_OK) {
+    return server_str_P(PSTR("{}"));
+  }
+  sprintf_P(g_json_str,
+            PSTR("{\"rule\":%u,\"metric\":\"%c\",\"op\":\"%c\","
+                 "\"threshold\":%u,\"hysteresis\":%u,\"duration\":%u}"),
+            rule,
+            copy.metric < ALERT_METRICS_NUM
+                ? pgm_read_byte(&g_metric_chars[copy.metric])
+                : '-',
+            copy.direction == ALERT_ABOVE ? '>' : '<', copy.threshold,
+            copy.hysteresis, copy.duration_s);
+  return g_json_str;
+}
+
+/* Sets a rule from a request, metric "-" disables it. */
+static const char *server_set_rule_str(uint8_t rule, const char *metric_str,
+                                       const char *op_str,
+                                       const alert_rule_t *p_values) {
+  alert_rule_t copy = *p_values;
+  const char *p_metric = strchr_P(g_metric_chars, metric_str[0]);
+  copy.metric = p_metric != NULL ? p_metric - g_metric_chars
+                                 : ALERT_METRIC_NONE;
+  copy.direction = op_str[0] == '>' ? ALERT_ABOVE : ALERT_BELOW;
+  if (alert_set_rule(rule, &copy) != ALERT_OK) {
+    return server_str_P(PSTR("{}"));
+  }
+  return server_rule_str(rule);
+}
+
+/* Transitions logged, one per request, 0 is the newest. */
+static const char *server_event_str(uint8_t index) {
+  alert_event_t event;
+  if (alert_get_event(index, &event) != ALERT_OK) {
+    return server_str_P(PSTR("{}"));
+  }
+  sprintf_P(g_json_str,
+            PSTR("{\"event\":%u,\"alert\":%u,\"active\":%u,"
+                 "\"value\":%u,\"ts\":%" PRIu32 "}"),
+            index, event.rule, event.b_active, event.value, event.epoch);
+  return g_json_str;
+}
+
+static const char *server_faults_str(void) {
+  fault_record_t record;
+  if (fault_get_record(&record) != FAULT_OK) {
+    return server_str_P(PSTR("{}"));
+  }
+  sprintf_P(g_json_str,
+            PSTR("{\"cause\":%u,\"resets\":{\"power_on\":%u,"
+                 "\"external\":%u,\"brown_out\":%u,\"watchdog\":%u,"
+                 "\"jtag\":%u},\"restarts\":{\"esp01\":%u,\"twi\":%u}}"),
+            record.last_reset_causes, record.resets[FAULT_RESET_POWER_ON],
+            record.resets[FAULT_RESET_EXTERNAL],
+            record.resets[FAULT_RESET_BROWN_OUT],
+            record.resets[FAULT_RESET_WATCHDOG],
+            record.resets[FAULT_RESET_JTAG],
+            record.restarts[FAULT_SUBSYSTEM_ESP01],
+            record.restarts[FAULT_SUBSYSTEM_TWI]);
+  return g_json_str;
+}
+
+/* Health of a sensor, one sensor per request like the profiled sections. */
+static const char *server_health_str(uint8_t sensor) {
+  weather_health_t health;
+  if (weather_get_health(sensor, &health) != Weather_OK) {
+    return server_str_P(PSTR("{}"));
+  }
+  sprintf_P(g_json_str,
+            PSTR("{\"sensor\":%u,\"measures\":%u,\"errors\":%u,"
+                 "\"retries\":%u,\"consecutive_errors\":%u,\"healthy\":%u,"
+                 "\"sensors\":%u}"),
+            sensor, health.measures, health.errors, health.retries,
+            health.consecutive_errors, health.healthy, Weather_Sensors_Num);
+  return g_json_str;
+}
+
+static const char *server_memory_str(void) {
+  profile_memory_t memory;
+  if (profile_get_memory(&memory) != PROFILE_OK) {
+    return server_str_P(PSTR("{}"));
+  }
+  sprintf_P(g_json_str, PSTR("{\"static\":%u,\"stack_unused\":%u}"),
+            memory.static_bytes, memory.stack_unused_bytes);
+  return g_json_str;
+}
+
+static const char *server_uart_str(void) {
+  esp01_stats_t stats;
+  if (esp01_get_stats(&stats) != ESP01_OK) {
+    return server_str_P(PSTR("{}"));
+  }
+  sprintf_P(g_json_str,
+            PSTR("{\"overruns\":%u,\"frame_errors\":%u,\"drops\":%u,"
+                 "\"tx_timeouts\":%u,\"flow\":%u}"),
+            stats.overruns, stats.frame_errors, stats.drops,
+            stats.tx_timeouts, stats.b_flow_control);
+  return g_json_str;
+}
+
+#ifdef PROFILE_ENABLE
+/* Cycles spent in a profiled section, one section per request as the whole
+ * table does not fit the response.
+ */
+static const char *server_stats_str(uint8_t section) {
+  static const char names[][PROFILE_SECTION_NAME_SIZE] PROGMEM =
+      PROFILE_SECTION_NAMES;
+  profile_entry_t entry;
+  if (profile_get_entry(section, &entry) != PROFILE_OK) {
+    return server_str_P(PSTR("{}"));
+  }
+  sprintf_P(g_json_str,
+            PSTR("{\"section\":\"%S\",\"count\":%" PRIu32
+                 ",\"min\":%" PRIu32 ",\"max\":%" PRIu32
+                 ",\"avg\":%" PRIu32 ",\"sections\":%u}"),
+            names[section], entry.count, entry.min, entry.max,
+            entry.count ? (uint32_t)(entry.total / entry.count) : 0,
+            PROFILE_SECTIONS_NUM);
+  return g_json_str;
+}
+#endif
+
+static const char *server_since_str(uint8_t link_id, uint32_t since_seq) {
+  uint16_t length;
+  if (storage_get_length(&length) != STORAGE_OK || length == 0 ||
+      gh_get_entry(0, &g_entry) != SERVER_OK || g_entry.seq == since_seq) {
+    /* Nothing new, hold the link until server_notify() pushes. */
+    if (link_id < ESP01_LINKS_NUM) {
+      g_since_link_mask |= 1 << link_id;
+    }
+    return "";
+  }
+
+  /* Oldest unseen entry, the client pages forward with its seq. A seq out
+   * of reach, e.g. from the future after storage was wiped, starts over from
+   * the oldest. Seqs wrap around at STORAGE_SEQ_BITS.
+   */
+  uint32_t distance = (g_entry.seq - since_seq) & STORAGE_SEQ_MASK;
+  if (distance > length) {
+    distance = length;
+  }
+  return server_index_str(distance - 1);
+}
+
+static const char *gh_response_str(uint8_t link_id,
+                                   const char *request_json_str) {
+  uint8_t b_subscribe;
+  if (sscanf_P(request_json_str, PSTR("{\"subscribe\": %hhu}"),
+               &b_subscribe) == 1 &&
+      link_id < ESP01_LINKS_NUM) {
+    if (b_subscribe) {
+      g_subscribe_link_mask |= 1 << link_id;
+      /* The latest entry is the baseline frames are applied on. */
+      return server_latest_str();
+    }
+    g_subscribe_link_mask &= ~(1 << link_id);
+    return server_str_P(PSTR("{\"subscribe\":0}"));
+  }
+
+  uint32_t since_seq;
+  if (sscanf_P(request_json_str, PSTR("{\"since\": %" SCNu32 "}"),
+               &since_seq) == 1) {
+    return server_since_str(link_id, since_seq);
+  }
+
+  uint16_t index = 0;
+  if (sscanf_P(request_json_str, PSTR("{\"packed\": %" SCNu16 "}"),
+               &index) == 1) {
+    return server_packed_str(index);
+  }
+  /* NOTE: The window and the seq to continue from are optional, each one
+   *       on its own.
+   */
+  char key_str[6], metric_str[2], op_str[3];
+  uint8_t threshold;
+  if (sscanf_P(request_json_str,
+               PSTR("{\"%5[a-z]\": \"%1[thl]%2[<>=!]%hhu\""), key_str,
+               metric_str, op_str, &threshold) == 4) {
+    uint32_t after_epoch = 0, from_seq = 0, newest_seq;
+    const char *p_arg = strstr_P(request_json_str, PSTR("\"after\":"));
+    if (p_arg != NULL) {
+      sscanf_P(p_arg, PSTR("\"after\": %" SCNu32), &after_epoch);
+    }
+    p_arg = strstr_P(request_json_str, PSTR("\"from\":"));
+    uint8_t b_from =
+        p_arg != NULL &&
+        sscanf_P(p_arg, PSTR("\"from\": %" SCNu32), &from_seq) == 1;
+    storage_query_t query;
+    if (server_get_query(metric_str, op_str, threshold, after_epoch,
+                         &query) != SERVER_OK ||
+        server_get_query_start(b_from, from_seq, &newest_seq, &index) !=
+            SERVER_OK) {
+      return server_str_P(PSTR("{}"));
+    }
+    if (strcmp_P(key_str, PSTR("count")) == 0) {
+      return server_count_str(&query, index, newest_seq);
+    }
+    if (strcmp_P(key_str, PSTR("match")) == 0) {
+      return server_match_str(&query, index, newest_seq);
+    }
+    return server_str_P(PSTR("{}"));
+  }
+
+  /* NOTE: A rule alone is read, a rule with every field is set. */
+  uint8_t rule;
+  alert_rule_t rule_values;
+  int8_t fields = sscanf_P(
+      request_json_str,
+      PSTR("{\"rule\": %hhu, \"metric\": \"%1[thl-]\", \"op\": \"%1[<>]\", "
+           "\"threshold\": %hhu, \"hysteresis\": %hhu, \"duration\": %" SCNu16
+           "}"),
+      &rule, metric_str, op_str, &rule_values.threshold,
+      &rule_values.hysteresis, &rule_values.duration_s);
+  if (fields == 1) {
+    return server_rule_str(rule);
+  }
+  if (fields == 6) {
+    return server_set_rule_str(rule, metric_str, op_str, &rule_values);
+  }
+  if (fields > 1) {
+    return server_str_P(PSTR("{}"));
+  }
+
+  uint8_t event_index;
+  if (sscanf_P(request_json_str, PSTR("{\"event\": %hhu}"), &event_index) ==
+      1) {
+    return server_event_str(event_index);
+  }
+
+  uint8_t b_faults;
+  if (sscanf_P(request_json_str, PSTR("{\"faults\": %hhu}"), &b_faults) == 1) {
+    return server_faults_str();
+  }
+
+  uint8_t sensor;
+  if (sscanf_P(request_json_str, PSTR("{\"health\": %hhu}"), &sensor) == 1) {
+    return server_health_str(sensor);
+  }
+
+  uint8_t b_memory;
+  if (sscanf_P(request_json_str, PSTR("{\"memory\": %hhu}"), &b_memory) == 1) {
+    return server_memory_str();
+  }
+
+  uint8_t b_uart;
+  if (sscanf_P(request_json_str, PSTR("{\"uart\": %hhu}"), &b_uart) == 1) {
+    return server_uart_str();
+  }
+
+#ifdef PROFILE_ENABLE
+  uint8_t section;
+  if (sscanf_P(request_json_str, PSTR("{\"stats\": %hhu}"), &section) == 1) {
+    return server_stats_str(section);
+  }
+#endif
+
+  uint8_t b_layout;
+  if (sscanf_P(request_json_str, PSTR("{\"layout\": %hhu}"), &b_layout) == 1) {
+    return server_layout_str();
+  }
+
+  uint8_t b_latest;
+  if (sscanf_P(request_json_str, PSTR("{\"latest\": %hhu}"), &b_latest) == 1) {
+    return server_latest_str();
+  }
+
 #if B_INDEXED
-  sscanf(request_json_str, "{\"index\": %hhu}", &index);
+  sscanf_P(request_json_str, PSTR("{\"index\": %" SCNu16 "}"), &index);
 #else
-  static uint8_t prev_index = 0;
-  index = prev_index;
-  prev_index = (prev_index + 1) % TOTAL_BLOCKS;
+  static uint16_t prev_index = 0;
+  uint16_t length;
+  if (storage_get_length(&length) != STORAGE_OK || length == 0) {
+    return server_str_P(PSTR("{}"));
+  }
+  index = prev_index % length;
+  prev_index = (index + 1) % length;
 #endif
-  gh_get_entry(index, &g_entry);
-  sprintf(g_json_str,
-          "{\"timestamp\":{\"hour\":%d,\"minute\":%d,\"second\":%d,"
-          "\"dayOfMonth\":%d,\"month\":%d,\"year\":%d,\"dayOfWeek\":%d},"
-          "\"data\":{\"temperature\":%d,\"humidity\":%d,\"light\":%d}}",
-          bcd_to_uint8(g_entry.timestamp.time.hours),
-          bcd_to_uint8(g_entry.timestamp.time.minutes),
-          bcd_to_uint8(g_entry.timestamp.time.seconds),
-          bcd_to_uint8(g_entry.timestamp.time.dayOfMonth),
-          bcd_to_uint8(g_entry.timestamp.time.month),
-          bcd_to_uint8(g_entry.timestamp.time.year),
-          bcd_to_uint8(g_entry.timestamp.time.dayOfWeek),
-          g_entry.data.as_struct.temperature, g_entry.data.as_struct.humidity,
-          g_entry.data.as_struct.light);
-  return g_json_str;
+  return server_index_str(index);
 }
 
 server_status_t server_init(void) {
-  if (esp01_init_as_access_point(SERVER_SSID_STR, SERVER_PASSWD_STR) ==
-      ESP01_OK) {
+  if (esp01_init_as_access_point(PSTR(SERVER_SSID_STR),
+                                 PSTR(SERVER_PASSWD_STR)) == ESP01_OK) {
     return SERVER_OK;
   }
   return SERVER_ERROR;
 }
 
-server_status_t server_run(void (*h_get_entry)(uint8_t index,
-                                               server_entry_t *p_entry)) {
+server_status_t server_run(server_status_t (*h_get_entry)(
+    uint16_t index, server_entry_t *p_entry)) {
   if (h_get_entry != NULL) {
     gh_get_entry = h_get_entry;
-    if (esp01_run_server(SERVER_PORT_STR, gh_response_str) == ESP01_OK) {
+    if (esp01_run_server(PSTR(SERVER_PORT_STR), gh_response_str) == ESP01_OK) {
+      gb_running = 1;
       return SERVER_OK;
     }
   }
   return SERVER_ERROR;
 }
 
+server_status_t server_notify(void) {
+  uint8_t link_mask;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    link_mask = g_since_link_mask;
+    g_since_link_mask = 0;
+  }
+  server_status_t status = SERVER_OK;
+  if (server_push_links(link_mask, server_latest_str)) {
+    status = SERVER_ERROR;
+  }
+  server_push_subscribers(server_sample_frame_str);
+  return status;
+}
+
+server_status_t server_get_subscribed(uint8_t *pb_subscribed) {
+  if (pb_subscribed == NULL) {
+    return SERVER_ERROR;
+  }
+  *pb_subscribed = !!g_subscribe_link_mask;
+  return SERVER_OK;
+}
+
+server_status_t server_push_live(const server_entry_data_t *p_data) {
+  if (p_data == NULL) {
+    return SERVER_ERROR;
+  }
+  gp_live_data = p_data;
+  server_push_subscribers(server_live_frame_str);
+  return SERVER_OK;
+}
+
+server_status_t server_push_alert(const alert_event_t *p_event) {
+  if (p_event == NULL) {
+    return SERVER_ERROR;
+  }
+  gp_alert_event = p_event;
+  server_push_subscribers(server_alert_frame_str);
+  return SERVER_OK;
+}
+
 server_status_t server_kill(void) {
+  gb_running = 0;
   if (esp01_kill_server() == ESP01_OK) {
     return SERVER_OK;
   }
   return SERVER_ERROR;
 }
+
+server_status_t server_probe(void) {
+  if (gb_running && esp01_probe() == ESP01_OK) {
+    return SERVER_OK;
+  }
+  return SERVER_ERROR;
+}
+
+server_status_t server_ready(void) {
+  if (esp01_probe() == ESP01_OK) {
+    return SERVER_OK;
+  }
+  return SERVER_ERROR;
+}
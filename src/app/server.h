@@ -8,7 +8,7 @@
 #ifndef SERVER_H
 #define SERVER_H
 
-#include "../hal/ds1307.h"
+#include "alert.h"
 #include "weather.h"
 #include <stdint.h>
 
@@ -29,13 +29,23 @@ typedef union {
 } server_entry_data_t;
 
 typedef struct {
-  RTC_Time_t timestamp;
+  uint32_t seq;       /* survives resets, wraps at STORAGE_SEQ_BITS */
+  uint32_t timestamp; /* seconds since 2000-01-01 00:00:00, rounded down to
+                         STORAGE_TIME_RESOLUTION_S */
   server_entry_data_t data;
 } server_entry_t;
 
 server_status_t server_init(void);
-server_status_t server_run(void (*h_get_entry)(uint8_t index,
-                                               server_entry_t *p_entry));
+server_status_t server_run(server_status_t (*h_get_entry)(
+    uint16_t index, server_entry_t *p_entry));
+server_status_t server_notify(void);
+server_status_t server_get_subscribed(uint8_t *pb_subscribed);
+server_status_t server_push_live(const server_entry_data_t *p_data);
+server_status_t server_push_alert(const alert_event_t *p_event);
 server_status_t server_kill(void);
+server_status_t server_probe(void);
+
+/* Probes the module whether the server runs or not, e.g. while it boots. */
+server_status_t server_ready(void);
 
 #endif /* SERVER_H */
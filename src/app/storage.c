@@ -4,122 +4,654 @@
  *
  * This file contains definitions for functions related to storage measurement
  * and management.
- * It stores any data along with current data and time automatically.
- * It uses circular queue to handle storage in EEPROM.
+ * It stores any data along with a sequence number and the current date and
+ * time automatically.
+ * It uses circular queue to handle storage on a pluggable backend, such as
+ * the internal EEPROM or an external I2C EEPROM/FRAM.
+ * New blocks are staged in SRAM and committed in bursts of
+ * STORAGE_BATCH_SIZE, readers see staged blocks as if they were committed.
+ * Blocks hold a record bit-packed to the widths of STORAGE_DATA_FIELDS.
+ * Every block is protected by a CRC and a commit byte written last, and
+ * storage_init recovers the head of the queue by scanning for the highest
+ * valid sequence number, so a block torn by a power cut is skipped rather
+ * than served.
  *
  * @author Mahmoud Gamal
  * @date May 10 2024
  */
 
 #include "storage.h"
+#include "fault.h"
+#include "../mcal/profile.h"
+#include "../mcal/timer.h"
 #include "../mcal/twi.h"
-#include <avr/eeprom.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+
+// Layout of a block on the backend, staged blocks use it too so that a batch
+// is written as one image
+typedef struct {
+  uint8_t record[STORAGE_RECORD_SIZE];
+  uint8_t crc;    // CRC8 of the record
+  uint8_t commit; // STORAGE_COMMIT_MARK once the block was completely written
+} storage_block_t;
+
+#define STORAGE_COMMIT_OFFSET offsetof(storage_block_t, commit)
+
+_Static_assert(sizeof(storage_block_t) == STORAGE_BLOCK_SIZE,
+               "STORAGE_BLOCK_SIZE does not match storage_block_t");
+
+// Width of every data field in a packed record
+static const uint8_t g_storage_data_bits[] = {
+    STORAGE_DATA_FIELDS(STORAGE_FIELD_BITS_ENTRY)
+};
+
+_Static_assert(sizeof(g_storage_data_bits) == STORAGE_BLOCK_DATA_SIZE,
+               "STORAGE_DATA_FIELDS needs one field per data byte");
+_Static_assert(STORAGE_SEQ_BITS >= 16 && STORAGE_SEQ_BITS <= 32 &&
+               STORAGE_TIME_BITS <= 32,
+               "STORAGE_SEQ_BITS or STORAGE_TIME_BITS out of range");
+
+// Backend the circular queue lives on
+static const storage_backend_t *gp_storage_backend = NULL;
+
+// Number of blocks fitting on the backend
+static uint16_t g_storage_total_blocks = 0;
 
 // Circular queue indices
-static uint8_t g_storage_cursor = 0;
+static uint16_t g_storage_cursor = 0;
+
+// Number of valid blocks behind the cursor
+static uint16_t g_storage_length = 0;
+
+// Blocks waiting to be committed at the cursor, oldest first
+static storage_block_t g_storage_staged[STORAGE_BATCH_SIZE];
+static uint8_t g_storage_staged_length = 0;
+
+// The indices above as readers see them, published as a latch: the writer
+// fills the copy readers are not on, then bumps the sequence to switch them
+// over. A reader interrupting the writer thus always finds a consistent copy
+// and never has to wait for the writer to finish
+typedef struct {
+    uint16_t cursor;
+    uint16_t length;
+    uint8_t staged_length;
+} storage_indices_t;
 
-// Function to calculate EEPROM address for a given block index
-static storage_status_t get_eeprom_address(uint8_t block_index, 
-    void **pp_address) {
-    if (block_index >= TOTAL_BLOCKS) {
+static storage_indices_t g_storage_indices[2];
+static volatile uint8_t g_storage_indices_seq = 0;
+
+// Set while the backend or the bus it shares with the RTC is in use
+static volatile bool gb_storage_backend_busy = false;
+
+// Time the oldest staged block was enqueued at
+static uint32_t g_storage_staged_ms = 0;
+
+// Sequence number of the next block
+static uint32_t g_storage_seq = 0;
+
+// Bumped after every enqueued block so readers can invalidate what they cache
+static uint16_t g_storage_generation = 0;
+
+// Function to calculate backend address for a given block index
+static storage_status_t get_block_address(uint16_t block_index, 
+    uint32_t *p_address) {
+    if (block_index >= g_storage_total_blocks) {
         return STORAGE_ERROR;
     }
-    *pp_address = (void *)(STORAGE_BASE_ADDRESS + (block_index * 
-          STORAGE_BLOCK_SIZE));
+    *p_address = STORAGE_BASE_ADDRESS + ((uint32_t)block_index * 
+          STORAGE_BLOCK_SIZE);
     return STORAGE_OK;
 }
 
-// Function to increment a circular queue index
-static void move_cursor(void) {
-    g_storage_cursor = (g_storage_cursor + 1) % TOTAL_BLOCKS;
-    eeprom_write_byte((void *)STORAGE_CURSOR_ADDRESS, g_storage_cursor);
+// Function to write a value at a bit position of a packed record
+static void pack_bits(uint8_t *p_record, uint8_t *p_bit, uint32_t value,
+    uint8_t bits) {
+    // Clamp what does not fit rather than letting it wrap around
+    uint32_t max = 0xFFFFFFFFUL >> (32 - bits);
+    if (value > max) {
+        value = max;
+    }
+    for (uint8_t i = 0; i < bits; ++i, ++*p_bit) {
+        uint8_t mask = 1 << (*p_bit % 8);
+        if (value & 1) {
+            p_record[*p_bit / 8] |= mask;
+        } else {
+            p_record[*p_bit / 8] &= ~mask;
+        }
+        value >>= 1;
+    }
 }
 
+// Function to read a value at a bit position of a packed record
+static uint32_t unpack_bits(const uint8_t *p_record, uint8_t *p_bit,
+    uint8_t bits) {
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < bits; ++i, ++*p_bit) {
+        if (p_record[*p_bit / 8] & (1 << (*p_bit % 8))) {
+            value |= 1UL << i;
+        }
+    }
+    return value;
+}
 
-// Function to initialize storage system
-storage_status_t storage_init(void) {
-    // Initialize EEPROM
-    eeprom_busy_wait();
+// Function to pack a stamp and data into a record
+static void pack_record(uint8_t *p_record, const storage_stamp_t *p_stamp,
+    const uint8_t *p_data) {
+    uint8_t bit = 0;
+    memset(p_record, 0, STORAGE_RECORD_SIZE);
+    pack_bits(p_record, &bit, p_stamp->seq, STORAGE_SEQ_BITS);
+    pack_bits(p_record, &bit, p_stamp->epoch / STORAGE_TIME_RESOLUTION_S,
+        STORAGE_TIME_BITS);
+    for (uint8_t i = 0; i < STORAGE_BLOCK_DATA_SIZE; ++i) {
+        pack_bits(p_record, &bit, p_data[i], g_storage_data_bits[i]);
+    }
+}
+
+// Function to unpack a record into a stamp and data, either may be NULL
+static void unpack_record(const uint8_t *p_record, storage_stamp_t *p_stamp,
+    uint8_t *p_data) {
+    uint8_t bit = 0;
+    storage_stamp_t stamp;
+    stamp.seq = unpack_bits(p_record, &bit, STORAGE_SEQ_BITS);
+    stamp.epoch = unpack_bits(p_record, &bit, STORAGE_TIME_BITS) *
+        STORAGE_TIME_RESOLUTION_S;
+    if (p_stamp != NULL) {
+        *p_stamp = stamp;
+    }
+    if (p_data != NULL) {
+        for (uint8_t i = 0; i < STORAGE_BLOCK_DATA_SIZE; ++i) {
+            p_data[i] = unpack_bits(p_record, &bit, g_storage_data_bits[i]);
+        }
+    }
+}
+
+// Function to tell whether a sequence number follows another one, taking the
+// wrap around into account
+static bool is_seq_newer(uint32_t seq, uint32_t than_seq) {
+    uint32_t distance = (seq - than_seq) & STORAGE_SEQ_MASK;
+    return distance != 0 && distance <= (STORAGE_SEQ_MASK >> 1);
+}
+
+// Function to publish the queue indices to readers
+static void publish_indices(void) {
+    storage_indices_t *p_indices =
+        &g_storage_indices[(g_storage_indices_seq + 1) & 1];
+    p_indices->cursor = g_storage_cursor;
+    p_indices->length = g_storage_length;
+    p_indices->staged_length = g_storage_staged_length;
+    // A single byte store switches readers over
+    ++g_storage_indices_seq;
+}
+
+// Function to get a consistent copy of the queue indices
+static void snapshot_indices(storage_indices_t *p_indices) {
+    // The copy is retried if a publish lands in between. The writer only runs
+    // from the main loop, so a reader in an interrupt never retries
+    uint8_t seq;
+    do {
+        seq = g_storage_indices_seq;
+        *p_indices = g_storage_indices[seq & 1];
+    } while (seq != g_storage_indices_seq);
+}
+
+// Function to take the backend, fails when interrupted code holds it
+static bool claim_backend(void) {
+    bool b_claimed = false;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (!gb_storage_backend_busy) {
+            gb_storage_backend_busy = true;
+            b_claimed = true;
+        }
+    }
+    return b_claimed;
+}
+
+// Function to give the backend back
+static void release_backend(void) {
+    gb_storage_backend_busy = false;
+}
+
+// Function to calculate the CRC of a block
+static uint8_t get_block_crc(const storage_block_t *p_block) {
+    const uint8_t *p_byte = (const uint8_t *)p_block;
+    uint8_t crc = 0xFF;
+    for (uint8_t i = 0; i < offsetof(storage_block_t, crc); ++i) {
+        crc = _crc8_ccitt_update(crc, p_byte[i]);
+    }
+    return crc;
+}
+
+// Function to read a block and check that it was completely written
+static storage_status_t read_block(uint16_t block_index,
+    storage_block_t *p_block) {
+    uint32_t address;
+    if (get_block_address(block_index, &address) != STORAGE_OK ||
+        gp_storage_backend->read(address, p_block, STORAGE_BLOCK_SIZE) !=
+        STORAGE_OK) {
+        return STORAGE_ERROR;
+    }
+    if (p_block->commit != STORAGE_COMMIT_MARK ||
+        p_block->crc != get_block_crc(p_block)) {
+        return STORAGE_ERROR;
+    }
+    return STORAGE_OK;
+}
+
+// Function to set the commit byte of consecutive blocks, oldest first
+static storage_status_t write_commits(uint16_t block_index, uint8_t count,
+    uint8_t commit) {
+    for (; count > 0; --count) {
+        uint32_t address;
+        if (get_block_address(block_index, &address) != STORAGE_OK ||
+            gp_storage_backend->write(address + STORAGE_COMMIT_OFFSET,
+                &commit, 1) != STORAGE_OK) {
+            return STORAGE_ERROR;
+        }
+        block_index = (block_index + 1) % g_storage_total_blocks;
+    }
+    return STORAGE_OK;
+}
+
+// Function to write consecutive blocks in one burst, wrapping at the end
+static storage_status_t write_blocks(uint16_t block_index,
+    const storage_block_t *p_blocks, uint8_t count) {
+    // The commit byte of a slot keeps its mark from the previous lap, as the
+    // backend skips unchanged bytes, so a power cut tearing the burst would
+    // leave the CRC alone to tell the block apart. The slots are cleared
+    // first and only marked once the burst completed, the staged blocks
+    // hold STORAGE_COMMIT_CLEAR already
+    if (write_commits(block_index, count, STORAGE_COMMIT_CLEAR) !=
+        STORAGE_OK) {
+        return STORAGE_ERROR;
+    }
+    uint16_t first_index = block_index;
+    uint8_t remaining = count;
+    while (remaining > 0) {
+        uint32_t address;
+        uint16_t run = g_storage_total_blocks - block_index;
+        if (run > remaining) {
+            run = remaining;
+        }
+        if (get_block_address(block_index, &address) != STORAGE_OK ||
+            gp_storage_backend->write(address, p_blocks,
+                run * STORAGE_BLOCK_SIZE) != STORAGE_OK) {
+            return STORAGE_ERROR;
+        }
+        p_blocks += run;
+        remaining -= run;
+        block_index = (block_index + run) % g_storage_total_blocks;
+    }
+    return write_commits(first_index, count, STORAGE_COMMIT_MARK);
+}
+
+// Function to rebuild the queue indices from the blocks on the backend
+static void recover_queue(void) {
+    // The head of the queue follows the valid block holding the newest
+    // sequence number, torn and erased blocks are skipped. The queue is far
+    // shorter than half the sequence space, so the newest is well defined
+    // across a wrap around
+    storage_block_t block;
+    storage_stamp_t stamp;
+    g_storage_cursor = 0;
+    g_storage_length = 0;
+    g_storage_staged_length = 0;
+    g_storage_seq = 0;
+    for (uint16_t block_index = 0; block_index < g_storage_total_blocks;
+         ++block_index) {
+        // Scanning a large external chip outlasts the watchdog timeout
+        if (block_index % STORAGE_FEED_BLOCKS == 0) {
+            fault_feed();
+        }
+        if (read_block(block_index, &block) != STORAGE_OK) {
+            continue;
+        }
+        unpack_record(block.record, &stamp, NULL);
+        if (g_storage_length++ == 0 ||
+            !is_seq_newer(g_storage_seq, stamp.seq)) {
+            g_storage_seq = (stamp.seq + 1) & STORAGE_SEQ_MASK;
+            g_storage_cursor = (block_index + 1) % g_storage_total_blocks;
+        }
+    }
+    publish_indices();
+}
 
-    // Read last version of rear and data length
-    g_storage_cursor = eeprom_read_byte((const uint8_t *)STORAGE_CURSOR_ADDRESS);
 
+// Function to initialize storage system
+storage_status_t storage_init(const storage_backend_t *p_backend) {
+    if (p_backend == NULL) {
+        return STORAGE_ERROR;
+    }
+
+    // The bus serves the RTC and external backends
     TWI_ConfigType twi_cfg = {.address = RTC_TWI_ADDRESS, .bit_rate = 100};
     TWI_init(&twi_cfg);
+
+    // Initialize backend
+    uint32_t total_blocks = p_backend->size() / STORAGE_BLOCK_SIZE;
+    if (total_blocks == 0) {
+        return STORAGE_ERROR;
+    }
+    // Keep the queue shorter than half the sequence space, see recover_queue
+    if (total_blocks > (STORAGE_SEQ_MASK >> 1)) {
+        total_blocks = STORAGE_SEQ_MASK >> 1;
+    }
+    // Readers fail until the queue is recovered
+    gp_storage_backend = NULL;
+    g_storage_total_blocks = total_blocks > UINT16_MAX ? UINT16_MAX :
+        total_blocks;
+
+    claim_backend();
+    gp_storage_backend = p_backend;
+    recover_queue();
+    release_backend();
     
     return STORAGE_OK;
 }
 
+// Function to erase the backend and empty the circular queue
+storage_status_t storage_format(void) {
+    if (gp_storage_backend == NULL) {
+        return STORAGE_ERROR;
+    }
+    // Erased in chunks, the watchdog is fed in between
+    const uint16_t chunk_max = STORAGE_FEED_BLOCKS * STORAGE_BLOCK_SIZE;
+    uint32_t size = (uint32_t)g_storage_total_blocks * STORAGE_BLOCK_SIZE;
+    claim_backend();
+    for (uint32_t address = 0; address < size; address += chunk_max) {
+        uint32_t chunk = size - address;
+        fault_feed();
+        if (gp_storage_backend->erase(STORAGE_BASE_ADDRESS + address,
+                chunk > chunk_max ? chunk_max : chunk) != STORAGE_OK) {
+            release_backend();
+            return STORAGE_ERROR;
+        }
+    }
+
+    recover_queue();
+    release_backend();
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      ++g_storage_generation;
+    }
+
+    return STORAGE_OK;
+}
+
 // Function to add a block of data
 storage_status_t storage_enqueue_block(const uint8_t *p_data) {
-  if (p_data == NULL) {
+  PROFILE_SCOPE(PROFILE_STORAGE_ENQUEUE);
+  if (p_data == NULL || gp_storage_backend == NULL) {
     return STORAGE_ERROR;
   }
-    // Calculate timestamp
+    // Calculate timestamp, the RTC shares the bus with external backends
     RTC_Time_t timestamp;
-    if (RTC_getTime(&timestamp) != RTC_SUCCESS) {
+    claim_backend();
+    uint8_t rtc_status = RTC_getTime(&timestamp);
+    release_backend();
+    if (rtc_status != RTC_SUCCESS) {
       return STORAGE_ERROR;
     }
 
-    // Calculate EEPROM address for the given block index
-    void *eeprom_address;
-    if (get_eeprom_address(g_storage_cursor, &eeprom_address) != STORAGE_OK) {
+    // Make room for the block, a failed commit keeps the staged blocks
+    if (g_storage_staged_length == STORAGE_BATCH_SIZE &&
+        storage_flush() != STORAGE_OK) {
       return STORAGE_ERROR;
     }
-    
-    // Write data to EEPROM
-    eeprom_write_block(p_data, eeprom_address, STORAGE_BLOCK_DATA_SIZE);
-    eeprom_address += STORAGE_BLOCK_DATA_SIZE;
-    
-    // Write timestamp to EEPROM
-    eeprom_write_block(timestamp.timeArr, eeprom_address, sizeof(timestamp.timeArr));
-    
-    // Update storage rear
-    move_cursor();
+
+    storage_block_t *p_block = &g_storage_staged[g_storage_staged_length];
+    storage_stamp_t stamp = {
+        .seq = g_storage_seq,
+        .epoch = RTC_toEpoch(&timestamp),
+    };
+    pack_record(p_block->record, &stamp, p_data);
+    p_block->crc = get_block_crc(p_block);
+    p_block->commit = STORAGE_COMMIT_CLEAR; // marked by write_blocks
+
+    // Stage block, the slot was filled out of sight of readers
+    if (g_storage_staged_length == 0) {
+      timer_get_ms(&g_storage_staged_ms);
+    }
+    ++g_storage_staged_length;
+    publish_indices();
+    g_storage_seq = (g_storage_seq + 1) & STORAGE_SEQ_MASK;
+
+    // Invalidate anything rendered from the previous contents
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      ++g_storage_generation;
+    }
+
+    // Commit a full batch right away
+    if (g_storage_staged_length == STORAGE_BATCH_SIZE) {
+      return storage_flush();
+    }
     
     return STORAGE_OK;
 }
 
+// Function to commit staged blocks to the backend in one burst
+storage_status_t storage_flush(void) {
+    if (gp_storage_backend == NULL) {
+        return STORAGE_ERROR;
+    }
+    if (g_storage_staged_length == 0) {
+        return STORAGE_OK;
+    }
+
+    // Write staged blocks to backend, readers keep serving them from SRAM
+    // meanwhile. The slots written are past the end of the queue readers
+    // see, which is clamped to the capacity
+    claim_backend();
+    storage_status_t status = write_blocks(g_storage_cursor, g_storage_staged,
+        g_storage_staged_length);
+    release_backend();
+    if (status != STORAGE_OK) {
+        return STORAGE_ERROR;
+    }
+
+    // Update storage rear once for the whole batch
+    g_storage_cursor = (g_storage_cursor + g_storage_staged_length) %
+        g_storage_total_blocks;
+    g_storage_length += g_storage_staged_length;
+    if (g_storage_length > g_storage_total_blocks) {
+        g_storage_length = g_storage_total_blocks;
+    }
+    g_storage_staged_length = 0;
+    publish_indices();
+
+    return STORAGE_OK;
+}
+
+// Function to commit staged blocks that waited too long
+storage_status_t storage_routine(void) {
+    uint32_t now_ms;
+    if (g_storage_staged_length == 0 || timer_get_ms(&now_ms) != TIMER_OK ||
+        now_ms - g_storage_staged_ms < STORAGE_FLUSH_AGE_MS) {
+        return STORAGE_OK;
+    }
+    return storage_flush();
+}
+
 // Function to get the number of blocks stored in circular queue
-storage_status_t storage_get_length(uint8_t *p_length) {
+storage_status_t storage_get_length(uint16_t *p_length) {
   if (p_length == NULL) {
     return STORAGE_ERROR;
   }
-    // Calculate length of data stored in circular queue
-    *p_length = TOTAL_BLOCKS;
+    // Calculate length of data stored in circular queue, staged included
+    storage_indices_t indices;
+    snapshot_indices(&indices);
+    uint32_t length = (uint32_t)indices.length + indices.staged_length;
+    *p_length = length > g_storage_total_blocks ? g_storage_total_blocks :
+        length;
     
     return STORAGE_OK;
 }
 
-// Function to get block of data
-storage_status_t storage_get_block(uint8_t index, uint8_t *p_data, 
-    RTC_Time_t *p_timestamp) {
-    // Check if index is valid
-    if (index >= TOTAL_BLOCKS || p_data == NULL) {
+// Function to get the number of blocks the backend can hold
+storage_status_t storage_get_capacity(uint16_t *p_capacity) {
+    if (p_capacity == NULL) {
         return STORAGE_ERROR;
     }
+    *p_capacity = g_storage_total_blocks;
+    return STORAGE_OK;
+}
 
-    // Move index to start from latest element
-    if (g_storage_cursor > index) {
-      index = (g_storage_cursor - index - 1) % TOTAL_BLOCKS;
-    } else {
-      index = (g_storage_cursor + (TOTAL_BLOCKS - 1) - index) % TOTAL_BLOCKS;
+// Function to get the packed record of a block
+storage_status_t storage_get_record(uint16_t index, uint8_t *p_record) {
+    if (p_record == NULL || gp_storage_backend == NULL) {
+        return STORAGE_ERROR;
     }
 
-    // Calculate EEPROM address for the given block index
-    void *eeprom_address;
-    get_eeprom_address(index, &eeprom_address);
-    
-    // Read data from EEPROM
-    eeprom_read_block(p_data, eeprom_address, STORAGE_BLOCK_DATA_SIZE);
-    eeprom_address += STORAGE_BLOCK_DATA_SIZE;
-    
-    // Read timestamp from EEPROM
-    if (p_timestamp != NULL) {
-      eeprom_read_block(p_timestamp->timeArr, eeprom_address, 
-          sizeof(p_timestamp->timeArr));
+    // Check if index is valid, against one snapshot of the indices
+    storage_indices_t indices;
+    snapshot_indices(&indices);
+    uint32_t length = (uint32_t)indices.length + indices.staged_length;
+    if (index >= length || index >= g_storage_total_blocks) {
+        return STORAGE_ERROR;
+    }
+
+    // Serve staged blocks from SRAM
+    if (index < indices.staged_length) {
+        memcpy(p_record,
+            g_storage_staged[indices.staged_length - 1 - index].record,
+            STORAGE_RECORD_SIZE);
+        return STORAGE_OK;
+    }
+    index -= indices.staged_length;
+
+    // Move index to start from latest element
+    index = ((uint32_t)indices.cursor + g_storage_total_blocks - 1 - index) %
+        g_storage_total_blocks;
+
+    // Read block from backend, a block that fails its check is never served
+    if (!claim_backend()) {
+        return STORAGE_BUSY;
     }
+    storage_block_t block;
+    storage_status_t status = read_block(index, &block);
+    release_backend();
+    if (status != STORAGE_OK) {
+        return STORAGE_ERROR;
+    }
+    memcpy(p_record, block.record, STORAGE_RECORD_SIZE);
     
     return STORAGE_OK;
 }
+
+// Function to get block of data
+storage_status_t storage_get_block(uint16_t index, uint8_t *p_data, 
+    storage_stamp_t *p_stamp) {
+    uint8_t record[STORAGE_RECORD_SIZE];
+    if (p_data == NULL || storage_get_record(index, record) != STORAGE_OK) {
+        return STORAGE_ERROR;
+    }
+    unpack_record(record, p_stamp, p_data);
+    return STORAGE_OK;
+}
+
+// Function to tell whether a data byte satisfies a query
+static bool is_query_match(const storage_query_t *p_query, uint8_t value) {
+    switch (p_query->op) {
+    case STORAGE_QUERY_LT: return value < p_query->threshold;
+    case STORAGE_QUERY_LE: return value <= p_query->threshold;
+    case STORAGE_QUERY_GT: return value > p_query->threshold;
+    case STORAGE_QUERY_GE: return value >= p_query->threshold;
+    case STORAGE_QUERY_EQ: return value == p_query->threshold;
+    case STORAGE_QUERY_NE: return value != p_query->threshold;
+    }
+    return false;
+}
+
+// Function to scan blocks counting those matching a query
+storage_status_t storage_query(const storage_query_t *p_query, uint16_t index,
+    uint16_t scan_max, uint16_t match_max, storage_query_result_t *p_result) {
+    if (p_query == NULL || p_result == NULL ||
+        p_query->field >= STORAGE_BLOCK_DATA_SIZE ||
+        p_query->op > STORAGE_QUERY_NE) {
+        return STORAGE_ERROR;
+    }
+    p_result->count = 0;
+
+    uint16_t length;
+    bool b_window_end = false;
+    storage_get_length(&length);
+    for (; scan_max > 0 && index < length; --scan_max, ++index) {
+        // Only the block being looked at is unpacked, nothing is buffered
+        uint8_t record[STORAGE_RECORD_SIZE];
+        uint8_t data[STORAGE_BLOCK_DATA_SIZE];
+        storage_stamp_t stamp;
+        storage_status_t status = storage_get_record(index, record);
+        if (status == STORAGE_BUSY) {
+            // Resumable from the block that could not be read
+            p_result->next_index = index;
+            p_result->b_done = false;
+            return STORAGE_BUSY;
+        }
+        if (status != STORAGE_OK) {
+            // A torn block holds nothing to match
+            continue;
+        }
+        unpack_record(record, &stamp, data);
+
+        // Blocks are in time order, the rest of the queue is older
+        if (stamp.epoch < p_query->after_epoch) {
+            b_window_end = true;
+            break;
+        }
+        if (!is_query_match(p_query, data[p_query->field])) {
+            continue;
+        }
+        if (p_result->count++ == 0) {
+            p_result->newest_index = index;
+        }
+        p_result->oldest_index = index;
+        if (p_result->count == match_max) {
+            ++index;
+            break;
+        }
+    }
+
+    p_result->next_index = index;
+    p_result->b_done = b_window_end || index >= length;
+    return STORAGE_OK;
+}
+
+// Function to get the current time off the RTC
+storage_status_t storage_get_epoch(uint32_t *p_epoch) {
+    if (p_epoch == NULL || !claim_backend()) {
+        return STORAGE_ERROR;
+    }
+    RTC_Time_t time;
+    uint8_t rtc_status = RTC_getTime(&time);
+    release_backend();
+    if (rtc_status != RTC_SUCCESS) {
+        return STORAGE_ERROR;
+    }
+    *p_epoch = RTC_toEpoch(&time);
+    return STORAGE_OK;
+}
+
+// Function to free the bus the RTC and external backends share
+storage_status_t storage_recover_bus(void) {
+    // An interrupted reader must not find the bus half configured
+    if (!claim_backend()) {
+        return STORAGE_ERROR;
+    }
+    TWI_recover();
+    release_backend();
+    return STORAGE_OK;
+}
+
+// Function to get the generation counter
+storage_status_t storage_get_generation(uint16_t *p_generation) {
+    if (p_generation == NULL) {
+        return STORAGE_ERROR;
+    }
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      *p_generation = g_storage_generation;
+    }
+    return STORAGE_OK;
+}
@@ -4,8 +4,17 @@
  *
  * This file contains declarations for functions related to storage measurement
  * and management.
- * It stores any data along with current data and time automatically.
- * It uses circular queue to handle storage in EEPROM.
+ * It stores any data along with a sequence number and the current date and
+ * time automatically.
+ * It uses circular queue to handle storage on a pluggable backend, such as
+ * the internal EEPROM or an external I2C EEPROM/FRAM.
+ * Every block is protected by a CRC and a commit byte, so blocks torn by a
+ * power cut are detected and skipped.
+ * Reads are safe from interrupts, e.g. the server, while the main loop
+ * writes: they never wait, and a read that would need the backend while
+ * the interrupted code uses it fails with STORAGE_BUSY instead.
+ * Queries are evaluated while scanning, so that only their outcome has to
+ * leave the device.
  *
  * @author Mahmoud Gamal
  * @date May 10 2024
@@ -22,37 +31,172 @@
 /* The size is application dependent */
 #define STORAGE_BLOCK_DATA_SIZE 3
 
-// EEPROM base address
+/* Width in bits of every data byte in a packed record, one FIELD per byte.
+ * The widths are application dependent, values that do not fit are clamped.
+ * Defaults: temperature 0-50 C, humidity 0-100 %, light 0-255
+ */
+#ifndef STORAGE_DATA_FIELDS
+#define STORAGE_DATA_FIELDS(FIELD) FIELD(6) FIELD(7) FIELD(8)
+#endif
+
+// Width in bits of the sequence number, it wraps around at this width
+#ifndef STORAGE_SEQ_BITS
+#define STORAGE_SEQ_BITS 24
+#endif
+
+// Width in bits of the time and its resolution in seconds, the defaults
+// reach 2063 at one minute resolution
+#ifndef STORAGE_TIME_BITS
+#define STORAGE_TIME_BITS 25
+#endif
+#ifndef STORAGE_TIME_RESOLUTION_S
+#define STORAGE_TIME_RESOLUTION_S 60
+#endif
+
+// Backend base address
 #define STORAGE_BASE_ADDRESS         0x0000
 
-// EEPROM cursor address
-#define STORAGE_CURSOR_ADDRESS         0x03ff
+// Stamp written along with the data of every block when it is enqueued
+typedef struct {
+  uint32_t seq;   // increasing modulo STORAGE_SEQ_MASK + 1, continues across
+                  // resets
+  uint32_t epoch; // seconds since 2000-01-01 00:00:00, see RTC_toEpoch
+} storage_stamp_t;
+
+#define STORAGE_SEQ_MASK (0xFFFFFFFFUL >> (32 - STORAGE_SEQ_BITS))
+
+// Packed record layout: seq, time, then the data fields, least significant
+// bit first
+#define STORAGE_FIELD_BITS_SUM(bits) + (bits)
+#define STORAGE_FIELD_BITS_ENTRY(bits) (bits),
+#define STORAGE_DATA_BITS (0 STORAGE_DATA_FIELDS(STORAGE_FIELD_BITS_SUM))
+#define STORAGE_RECORD_BITS \
+  (STORAGE_SEQ_BITS + STORAGE_TIME_BITS + STORAGE_DATA_BITS)
+#define STORAGE_RECORD_SIZE ((STORAGE_RECORD_BITS + 7) / 8)
 
-// EEPROM block size
-#define STORAGE_BLOCK_SIZE (STORAGE_BLOCK_DATA_SIZE + sizeof(RTC_Time_t))
+// Block size: packed record, CRC8 and commit byte
+#define STORAGE_BLOCK_SIZE (STORAGE_RECORD_SIZE + 2)
 
-// EEPROM size 
-#define EEPROM_SIZE 1024
+// Commit byte of a completely written block, erased EEPROM reads 0xFF
+#define STORAGE_COMMIT_MARK 0xA5
 
-// total number of blocks
-#define TOTAL_BLOCKS ((EEPROM_SIZE - 1) / STORAGE_BLOCK_SIZE)
+// Commit byte of a block being written
+#define STORAGE_COMMIT_CLEAR 0x00
+
+// Blocks staged in SRAM and committed in one burst, 1 writes every block
+// through. Up to STORAGE_BATCH_SIZE - 1 blocks are lost on a power cut
+#ifndef STORAGE_BATCH_SIZE
+#define STORAGE_BATCH_SIZE 4
+#endif
+
+// Period between two storage_enqueue calls, must match the sampling routine
+#ifndef STORAGE_SAMPLE_PERIOD_MS
+#define STORAGE_SAMPLE_PERIOD_MS (10UL * 60 * 1000)
+#endif
+
+// Staged blocks are committed by storage_routine once the oldest one waited
+// this long, bounding the data lost on a power cut in time. Half a period past
+// the last sample of a batch, so a full batch forms before it fires and a
+// power cut loses at most a batch window of samples
+#ifndef STORAGE_FLUSH_AGE_MS
+#define STORAGE_FLUSH_AGE_MS \
+    ((STORAGE_BATCH_SIZE - 1) * STORAGE_SAMPLE_PERIOD_MS + \
+     STORAGE_SAMPLE_PERIOD_MS / 2)
+#endif
+
+// Blocks scanned or erased between watchdog feeds, about 50 ms of reads of
+// an external chip at 100 kHz and 1.2 s of internal EEPROM erase
+#define STORAGE_FEED_BLOCKS 32
 
 typedef enum {
   STORAGE_OK = 0,
   STORAGE_ERROR = 1,
+  STORAGE_BUSY = 2, // the backend is in use by interrupted code, retry later
 } storage_status_t;
 
-// Function to initialize storage system
-storage_status_t storage_init(void);
+// Comparison of a data byte against the threshold of a query
+typedef enum {
+  STORAGE_QUERY_LT = 0,
+  STORAGE_QUERY_LE = 1,
+  STORAGE_QUERY_GT = 2,
+  STORAGE_QUERY_GE = 3,
+  STORAGE_QUERY_EQ = 4,
+  STORAGE_QUERY_NE = 5,
+} storage_query_op_t;
+
+// Predicate evaluated on every block a query scans
+typedef struct {
+  uint8_t field;            // index of the data byte compared
+  storage_query_op_t op;
+  uint8_t threshold;
+  uint32_t after_epoch;     // blocks stamped before it are out of the window,
+                            // 0 for the whole queue
+} storage_query_t;
+
+// Outcome of a query scan, indices count from the newest block as in
+// storage_get_block
+typedef struct {
+  uint16_t count;          // matching blocks scanned
+  uint16_t newest_index;   // first match scanned, valid when count > 0
+  uint16_t oldest_index;   // last match scanned, valid when count > 0
+  uint16_t next_index;     // where a continued scan starts
+  bool b_done;             // the scan reached the end of the window
+} storage_query_result_t;
+
+// Medium the circular queue lives on, addresses are relative to its start
+typedef struct {
+  storage_status_t (*read)(uint32_t address, void *p_buf, uint16_t size);
+  storage_status_t (*write)(uint32_t address, const void *p_buf,
+                            uint16_t size);
+  // Fills with 0xFF, the value erased EEPROM reads
+  storage_status_t (*erase)(uint32_t address, uint16_t size);
+  uint32_t (*size)(void);
+} storage_backend_t;
+
+// Function to initialize storage system on a backend
+storage_status_t storage_init(const storage_backend_t *p_backend);
+
+// Function to erase the backend and empty the circular queue
+storage_status_t storage_format(void);
 
 // Function to add a block of data
 storage_status_t storage_enqueue_block(const uint8_t *p_data);
 
+// Function to commit staged blocks to the backend, e.g. before a reset
+storage_status_t storage_flush(void);
+
+// Function to commit staged blocks that waited too long, call periodically
+storage_status_t storage_routine(void);
+
 // Function to get the number of blocks stored in circular queue
-storage_status_t storage_get_length(uint8_t *p_length);
+storage_status_t storage_get_length(uint16_t *p_length);
+
+// Function to get the number of blocks the backend can hold
+storage_status_t storage_get_capacity(uint16_t *p_capacity);
 
 // Function to get block of data
-storage_status_t storage_get_block(uint8_t index, uint8_t *p_data,
-                                   RTC_Time_t *p_timestamp);
+storage_status_t storage_get_block(uint16_t index, uint8_t *p_data,
+                                   storage_stamp_t *p_stamp);
+
+// Function to get the packed record of a block, STORAGE_RECORD_SIZE bytes
+storage_status_t storage_get_record(uint16_t index, uint8_t *p_record);
+
+// Function to scan blocks from index towards older ones, counting those
+// matching a query. The scan stops after scan_max blocks, after match_max
+// matches unless 0, or at the end of the window
+storage_status_t storage_query(const storage_query_t *p_query, uint16_t index,
+                               uint16_t scan_max, uint16_t match_max,
+                               storage_query_result_t *p_result);
+
+// Function to get the current time off the RTC, which shares the bus with
+// external backends
+storage_status_t storage_get_epoch(uint32_t *p_epoch);
+
+// Function to free the bus the RTC and external backends share, e.g. after a
+// slave was left holding SDA
+storage_status_t storage_recover_bus(void);
+
+// Function to get the generation counter, bumped on every enqueued block
+storage_status_t storage_get_generation(uint16_t *p_generation);
 
 #endif /* STORAGE_H */
@@ -0,0 +1,103 @@
+/**
+ * @file storage_backend.c
+ * @brief Backends of the storage circular queue.
+ *
+ * This file contains definitions of the backends storage can be
+ * initialized on:
+ * the internal EEPROM of the MCU and an external 24LCxx EEPROM or FM24 FRAM
+ * on the TWI bus, configured in hal/eeprom24.h.
+ */
+
+#include "storage_backend.h"
+#include "../hal/eeprom24.h"
+#include <avr/eeprom.h>
+#include <stdint.h>
+
+// Function to check that a range lies within a backend of a given size
+static storage_status_t check_range(uint32_t address, uint16_t size,
+    uint32_t backend_size) {
+    if (address > backend_size || size > backend_size - address) {
+        return STORAGE_ERROR;
+    }
+    return STORAGE_OK;
+}
+
+/* -------- Internal EEPROM ---------- */
+
+static storage_status_t internal_read(uint32_t address, void *p_buf,
+    uint16_t size) {
+    if (check_range(address, size, STORAGE_INTERNAL_RESERVED_ADDRESS) !=
+        STORAGE_OK) {
+        return STORAGE_ERROR;
+    }
+    eeprom_read_block(p_buf, (const void *)(uintptr_t)address, size);
+    return STORAGE_OK;
+}
+
+static storage_status_t internal_write(uint32_t address, const void *p_buf,
+    uint16_t size) {
+    if (check_range(address, size, STORAGE_INTERNAL_RESERVED_ADDRESS) !=
+        STORAGE_OK) {
+        return STORAGE_ERROR;
+    }
+    // Bytes that already hold the value are not programmed again
+    eeprom_update_block(p_buf, (void *)(uintptr_t)address, size);
+    return STORAGE_OK;
+}
+
+static storage_status_t internal_erase(uint32_t address, uint16_t size) {
+    if (check_range(address, size, STORAGE_INTERNAL_RESERVED_ADDRESS) !=
+        STORAGE_OK) {
+        return STORAGE_ERROR;
+    }
+    for (; size > 0; --size, ++address) {
+        eeprom_update_byte((uint8_t *)(uintptr_t)address, 0xFF);
+    }
+    return STORAGE_OK;
+}
+
+static uint32_t internal_size(void) {
+    eeprom_busy_wait();
+    return STORAGE_INTERNAL_RESERVED_ADDRESS;
+}
+
+const storage_backend_t g_storage_backend_internal = {
+    .read = internal_read,
+    .write = internal_write,
+    .erase = internal_erase,
+    .size = internal_size,
+};
+
+/* -------- External I2C EEPROM/FRAM ---------- */
+
+static storage_status_t eeprom24_read(uint32_t address, void *p_buf,
+    uint16_t size) {
+    if (EEPROM24_read(address, p_buf, size) != EEPROM24_SUCCESS) {
+        return STORAGE_ERROR;
+    }
+    return STORAGE_OK;
+}
+
+static storage_status_t eeprom24_write(uint32_t address, const void *p_buf,
+    uint16_t size) {
+    if (EEPROM24_write(address, p_buf, size) != EEPROM24_SUCCESS) {
+        return STORAGE_ERROR;
+    }
+    return STORAGE_OK;
+}
+
+static storage_status_t eeprom24_erase(uint32_t address, uint16_t size) {
+    if (EEPROM24_erase(address, size) != EEPROM24_SUCCESS) {
+        return STORAGE_ERROR;
+    }
+    return STORAGE_OK;
+}
+
+static uint32_t eeprom24_size(void) { return EEPROM24_SIZE; }
+
+const storage_backend_t g_storage_backend_eeprom24 = {
+    .read = eeprom24_read,
+    .write = eeprom24_write,
+    .erase = eeprom24_erase,
+    .size = eeprom24_size,
+};
@@ -0,0 +1,31 @@
+/**
+ * @file storage_backend.h
+ * @brief Backends of the storage circular queue.
+ *
+ * This file contains declarations of the backends storage can be
+ * initialized on:
+ * the internal EEPROM of the MCU and an external 24LCxx EEPROM or FM24 FRAM
+ * on the TWI bus, configured in hal/eeprom24.h.
+ */
+
+#ifndef STORAGE_BACKEND_H
+#define STORAGE_BACKEND_H
+
+#include "storage.h"
+
+// Internal EEPROM size
+#define STORAGE_INTERNAL_EEPROM_SIZE 1024
+
+// Area at the top of the internal EEPROM left out of the backend for the
+// records of the application, e.g. the fault record and the alert log
+#define STORAGE_INTERNAL_RESERVED_SIZE 128
+#define STORAGE_INTERNAL_RESERVED_ADDRESS \
+    (STORAGE_INTERNAL_EEPROM_SIZE - STORAGE_INTERNAL_RESERVED_SIZE)
+
+// Internal EEPROM of the MCU
+extern const storage_backend_t g_storage_backend_internal;
+
+// External I2C EEPROM/FRAM
+extern const storage_backend_t g_storage_backend_eeprom24;
+
+#endif /* STORAGE_BACKEND_H */
@@ -1,5 +1,3 @@
-
-
 /*
  * author : Ahmed Aly Hussien Elwakad
  * version: 1.0
@@ -11,29 +9,192 @@
 #define WEATHER_C
 
 #include "weather.h"
+#include "alert.h"
+#include "fault.h"
 #include "../hal/dht11.h"
 #include "../mcal/adc.h"
+#include <stddef.h>
+#include <util/atomic.h>
+#include <util/delay.h>
 
 #define LDR_pin 0
 
+/* last DHT11 readings, the median of them is measured */
+static uint8_t g_temperature_window[WEATHER_DHT11_WINDOW];
+static uint8_t g_humidity_window[WEATHER_DHT11_WINDOW];
+static uint8_t g_window_length = 0;
+static uint8_t g_window_next = 0;
+
+/* age of the reading last put in the window, a smaller one is new */
+static uint32_t g_window_age_ms = UINT32_MAX;
+
+static weather_health_t g_health[Weather_Sensors_Num];
+
+/* backoffs outlast the watchdog timeout, so it is fed while waiting */
+static void weather_wait_ms(uint16_t ms){
+	while(ms--){
+		_delay_ms(1);
+		fault_feed();
+	}
+}
+
+/* median by insertion sort on a copy, the windows are only a few bytes */
+static uint8_t weather_median(const uint8_t * values ,uint8_t length){
+	uint8_t sorted[WEATHER_LIGHT_SAMPLES > WEATHER_DHT11_WINDOW ?
+	               WEATHER_LIGHT_SAMPLES : WEATHER_DHT11_WINDOW];
+	for(uint8_t i = 0; i < length; i++){
+		uint8_t j = i;
+		for(; j > 0 && sorted[j - 1] > values[i]; j--){
+			sorted[j] = sorted[j - 1];
+		}
+		sorted[j] = values[i];
+	}
+	return sorted[length / 2];
+}
+
+/* the server reads the health from the receive interrupt, so it is updated
+ * atomically */
+static void weather_health_update(weather_sensor_t sensor
+		                     ,weather_status_t status){
+	weather_health_t * health = &g_health[sensor];
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		health->measures++;
+		if(status == Weather_OK){
+			health->consecutive_errors = 0;
+		}else{
+			health->errors++;
+			if(health->consecutive_errors < UINT8_MAX){
+				health->consecutive_errors++;
+			}
+		}
+		health->healthy =
+			health->consecutive_errors < WEATHER_UNHEALTHY_ERRORS;
+	}
+}
+
+/* puts the cached DHT11 reading in the window once per transfer */
+static weather_status_t weather_dht11_collect(void){
+	uint8_t temperature, humidity;
+	uint32_t age_ms;
+	if(dht11_read(&temperature ,&humidity) || dht11_get_age(&age_ms)){
+		return Weather_Error;
+	}
+	if(age_ms < g_window_age_ms){
+		g_temperature_window[g_window_next] = temperature;
+		g_humidity_window[g_window_next] = humidity;
+		g_window_next = (g_window_next + 1) % WEATHER_DHT11_WINDOW;
+		if(g_window_length < WEATHER_DHT11_WINDOW){
+			g_window_length++;
+		}
+	}
+	g_window_age_ms = age_ms;
+	return Weather_OK;
+}
+
+static weather_status_t weather_dht11_measure(uint8_t * temperature
+		                             ,uint8_t * humidity){
+	uint16_t backoff_ms = WEATHER_DHT11_BACKOFF_MS;
+	weather_status_t status = Weather_Error;
+	for(uint8_t attempt = 0; attempt < WEATHER_RETRIES; attempt++){
+		if(attempt){
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+				g_health[Weather_DHT11].retries++;
+			}
+			weather_wait_ms(backoff_ms);
+			backoff_ms *= 2;
+		}
+		/* a stale cache is resampled on demand */
+		if(!weather_dht11_collect()){
+			status = Weather_OK;
+			break;
+		}
+	}
+	weather_health_update(Weather_DHT11 ,status);
+	if(status != Weather_OK){
+		return Weather_Error;
+	}
+	*temperature = weather_median(g_temperature_window ,g_window_length);
+	*humidity = weather_median(g_humidity_window ,g_window_length);
+	return Weather_OK;
+}
+
+static weather_status_t weather_light_measure(uint8_t * light){
+	uint16_t backoff_ms = WEATHER_LIGHT_BACKOFF_MS;
+	uint8_t samples[WEATHER_LIGHT_SAMPLES];
+	weather_status_t status = Weather_Error;
+	for(uint8_t attempt = 0; attempt < WEATHER_RETRIES; attempt++){
+		if(attempt){
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+				g_health[Weather_Light].retries++;
+			}
+			weather_wait_ms(backoff_ms);
+			backoff_ms *= 2;
+		}
+		uint8_t i = 0;
+		while(i < WEATHER_LIGHT_SAMPLES && !ADC_read(&samples[i] ,LDR_pin)){
+			i++;
+		}
+		if(i == WEATHER_LIGHT_SAMPLES){
+			status = Weather_OK;
+			break;
+		}
+	}
+	weather_health_update(Weather_Light ,status);
+	if(status != Weather_OK){
+		return Weather_Error;
+	}
+	*light = weather_median(samples ,WEATHER_LIGHT_SAMPLES);
+	return Weather_OK;
+}
+
 weather_status_t weather_init(void){
   ADC_init();
   dht11_init();
+  for(uint8_t sensor = 0; sensor < Weather_Sensors_Num; sensor++){
+	  g_health[sensor].healthy = 1;
+  }
 return Weather_OK;
 }
 
+weather_status_t weather_routine(void){
+	if(dht11_routine()){
+		return Weather_Error;
+	}
+	/* nothing cached yet is not an error of the routine */
+	weather_dht11_collect();
+	return Weather_OK;
+}
+
 weather_status_t weather_measures(uint8_t * temperature
 		                         ,uint8_t * humidity
 					 ,uint8_t * light){
 
+	if(temperature == NULL || humidity == NULL || light == NULL){
+		return Weather_Error;
+	}
+
+	/* both sensors are measured so that both health records stay current */
+	weather_status_t dht11_status = weather_dht11_measure(temperature ,humidity);
+	weather_status_t light_status = weather_light_measure(light);
 
-	if(dht11_read ( temperature, humidity)){
+	if(dht11_status || light_status){
 		return Weather_Error;
 	}
-	if(ADC_read ( light,LDR_pin)){
-			return Weather_Error;
-		}
 
+	/* every good sample feeds the alert rules, in the order of the stored
+	 * data */
+	uint8_t data[ALERT_METRICS_NUM] = {*temperature ,*humidity ,*light};
+	alert_evaluate(data);
+
+	return Weather_OK;
+}
+
+weather_status_t weather_get_health(weather_sensor_t sensor
+		                           ,weather_health_t * health){
+	if(sensor >= Weather_Sensors_Num || health == NULL){
+		return Weather_Error;
+	}
+	*health = g_health[sensor];
 	return Weather_OK;
 }
 
@@ -1,4 +1,3 @@
-
 /*
  * author : Ahmed Aly Hussien Elwakad
  * version: 1.0
@@ -12,18 +11,51 @@
 
 #include <stdint.h>
 
+/* attempts per sensor before weather_measures gives up, the wait between
+ * attempts starts at the backoff and doubles after every failed one */
+#define WEATHER_RETRIES            3
+#define WEATHER_DHT11_BACKOFF_MS   1000 /* DHT11 minimum sampling interval */
+#define WEATHER_LIGHT_BACKOFF_MS   10
+
+/* readings the median is taken over, odd so that a single spike is dropped */
+#define WEATHER_DHT11_WINDOW       3
+#define WEATHER_LIGHT_SAMPLES      5
+
+/* a sensor failing that many measures in a row is reported unhealthy */
+#define WEATHER_UNHEALTHY_ERRORS   3
+
 
 typedef enum{
 	Weather_OK,
 	Weather_Error
 }weather_status_t;
 
+typedef enum{
+	Weather_DHT11,
+	Weather_Light,
+	Weather_Sensors_Num
+}weather_sensor_t;
+
+typedef struct{
+	uint16_t measures;
+	uint16_t errors;             /* measures failed after all retries */
+	uint16_t retries;
+	uint8_t  consecutive_errors;
+	uint8_t  healthy;
+}weather_health_t;
+
 
 
 weather_status_t weather_init(void);
 
+/* keeps the DHT11 window fed, call it from the main loop */
+weather_status_t weather_routine(void);
+
 weather_status_t weather_measures(uint8_t * temperature
 		                         ,uint8_t * humidity
 					 ,uint8_t * light);
 
+weather_status_t weather_get_health(weather_sensor_t sensor
+		                           ,weather_health_t * health);
+
 #endif
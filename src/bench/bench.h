@@ -0,0 +1,52 @@
+/**
+ * @file bench.h
+ * @brief Section markers shared by the benchmark firmware and its runner
+ *
+ * The firmware writes a bench id to BENCH_MARK_REG as a section begins and
+ * the id with BENCH_MARK_END as it ends, bench/bench_run timestamps both
+ * writes with the simulated cycle counter. Timer2 is otherwise unused, so
+ * its compare register is free to carry the markers.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+/* OCR2 of the ATmega32A, I/O 0x23 is data address 0x43. */
+#define BENCH_MARK_ADDRESS 0x43
+#define BENCH_MARK_END 0x80
+
+/* NOTE: Names are in the same order, keep them in sync. */
+typedef enum : uint8_t {
+  BENCH_CALIBRATE, /* empty section, its cycles are the marker overhead */
+  BENCH_GPIO_PIN_DEFINE,
+  BENCH_GPIO_RUNTIME,
+  BENCH_DHT11_SAMPLE,
+  BENCH_DHT11_CACHED,
+  BENCH_STORAGE_ENQUEUE,
+  BENCH_STORAGE_FLUSH,
+  BENCH_STORAGE_GET,
+  BENCH_RESPONSE_LATEST,
+  BENCH_RESPONSE_PACKED,
+  BENCH_RESPONSE_LAYOUT,
+  BENCH_LCD_FLUSH,
+  BENCH_LCD_ROUTINE,
+  BENCH_IDS_NUM,
+  BENCH_DONE = BENCH_MARK_END - 1,
+} bench_id_t;
+
+#define BENCH_NAMES                                                            \
+  {"calibrate",       "gpio_pin_define", "gpio_runtime",    "dht11_sample",    \
+   "dht11_cached",    "storage_enqueue", "storage_flush",   "storage_get",     \
+   "response_latest", "response_packed", "response_layout", "lcd_flush",       \
+   "lcd_routine"}
+
+#ifdef __AVR__
+#include <avr/io.h>
+
+#define BENCH_BEGIN(ID) (OCR2 = (ID))
+#define BENCH_END(ID) (OCR2 = (ID) | BENCH_MARK_END)
+#endif
+
+#endif /* BENCH_H */
@@ -0,0 +1,189 @@
+/**
+ * @file bench_main.c
+ * @brief Benchmark firmware, run under simavr by bench/bench_run
+ *
+ * Runs every benchmark BENCH_RUNS_NUM times between markers, then ends with
+ * BENCH_DONE and sleeps with interrupts off, which stops the simulation.
+ * The ESP-01 link, the RTC and the fault record are stubbed out, the runner
+ * plays the DHT11.
+ */
+
+#include "../app/fault.h"
+#include "../app/server.h"
+#include "../app/storage.h"
+#include "../app/storage_backend.h"
+#include "../hal/dht11.h"
+#include "../hal/ds1307.h"
+#include "../hal/esp01.h"
+#include "../hal/lcd.h"
+#include "../mcal/gpio.h"
+#include "../mcal/timer.h"
+#include "bench.h"
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <stdint.h>
+#include <util/delay.h>
+
+#define BENCH_RUNS_NUM 16
+#define BENCH_DHT11_RUNS_NUM 3
+
+GPIO_PIN_DEFINE(bench_pin, GPIO_PORT_D, GPIO_PIN_7)
+
+static const char *(*gh_respond)(uint8_t, const char *);
+static uint32_t g_epoch;
+
+/* -------- Stubs ---------- */
+esp01_status_t esp01_init_as_access_point(const char *str_ssid_P,
+                                          const char *str_pass_P) {
+  return ESP01_OK;
+}
+
+esp01_status_t esp01_run_server(const char *str_port_P,
+                                const char *(*h_respond)(uint8_t link_id,
+                                                         const char *)) {
+  gh_respond = h_respond;
+  return ESP01_OK;
+}
+
+esp01_status_t esp01_push(uint8_t link_mask, const char *(*h_message)(void),
+                          uint8_t *p_failed_mask) {
+  return ESP01_OK;
+}
+
+esp01_status_t esp01_kill_server(void) { return ESP01_OK; }
+esp01_status_t esp01_probe(void) { return ESP01_OK; }
+esp01_status_t esp01_get_stats(esp01_stats_t *p_stats) { return ESP01_ERROR; }
+
+fault_status_t fault_get_record(fault_record_t *p_record) {
+  return FAULT_ERROR;
+}
+
+fault_status_t fault_feed(void) { return FAULT_OK; }
+
+weather_status_t weather_get_health(weather_sensor_t sensor,
+                                    weather_health_t *p_health) {
+  return Weather_Error;
+}
+
+uint8_t RTC_getTime(RTC_Time_t *time) { return RTC_SUCCESS; }
+
+/* One sample every ten minutes. */
+uint32_t RTC_toEpoch(const RTC_Time_t *time) { return g_epoch += 600; }
+
+/* -------- Benchmarks ---------- */
+static server_status_t get_entry(uint16_t index, server_entry_t *p_entry) {
+  storage_stamp_t stamp;
+  if (storage_get_block(index, p_entry->data.as_array, &stamp) != STORAGE_OK) {
+    return SERVER_ERROR;
+  }
+  p_entry->seq = stamp.seq;
+  p_entry->timestamp = stamp.epoch;
+  return SERVER_OK;
+}
+
+static void bench_gpio(void) {
+  bench_pin_set_direction(1);
+  gpio_set_pin_direction(GPIO_PORT_D, GPIO_PIN_7, 1);
+  for (uint8_t i = 0; i < BENCH_RUNS_NUM; ++i) {
+    BENCH_BEGIN(BENCH_GPIO_PIN_DEFINE);
+    bench_pin_set_level(i & 1);
+    BENCH_END(BENCH_GPIO_PIN_DEFINE);
+    BENCH_BEGIN(BENCH_GPIO_RUNTIME);
+    gpio_set_pin_level(GPIO_PORT_D, GPIO_PIN_7, i & 1);
+    BENCH_END(BENCH_GPIO_RUNTIME);
+  }
+}
+
+static void bench_dht11(void) {
+  uint8_t temperature, humidity;
+  for (uint8_t i = 0; i < BENCH_DHT11_RUNS_NUM; ++i) {
+    /* NOTE: The sensor is sampled once the refresh period passed. */
+    for (uint16_t ms = 0; ms < DHT11_REFRESH_PERIOD_MS; ++ms) {
+      _delay_ms(1);
+    }
+    BENCH_BEGIN(BENCH_DHT11_SAMPLE);
+    dht11_routine();
+    BENCH_END(BENCH_DHT11_SAMPLE);
+  }
+  for (uint8_t i = 0; i < BENCH_RUNS_NUM; ++i) {
+    BENCH_BEGIN(BENCH_DHT11_CACHED);
+    dht11_read(&temperature, &humidity);
+    BENCH_END(BENCH_DHT11_CACHED);
+  }
+}
+
+static void bench_storage(void) {
+  uint8_t data[STORAGE_BLOCK_DATA_SIZE] = {23, 45, 128};
+  storage_stamp_t stamp;
+  storage_init(&g_storage_backend_internal);
+  for (uint8_t i = 0; i < BENCH_RUNS_NUM; ++i) {
+    data[2] = i;
+    BENCH_BEGIN(BENCH_STORAGE_ENQUEUE);
+    storage_enqueue_block(data);
+    BENCH_END(BENCH_STORAGE_ENQUEUE);
+  }
+  for (uint8_t i = 0; i < BENCH_RUNS_NUM; ++i) {
+    storage_enqueue_block(data);
+    BENCH_BEGIN(BENCH_STORAGE_FLUSH);
+    storage_flush();
+    BENCH_END(BENCH_STORAGE_FLUSH);
+  }
+  for (uint8_t i = 0; i < BENCH_RUNS_NUM; ++i) {
+    BENCH_BEGIN(BENCH_STORAGE_GET);
+    storage_get_block(i, data, &stamp);
+    BENCH_END(BENCH_STORAGE_GET);
+  }
+}
+
+static void bench_response(void) {
+  server_init();
+  server_run(get_entry);
+  for (uint8_t i = 0; i < BENCH_RUNS_NUM; ++i) {
+    /* NOTE: Served from the cache after the first run. */
+    BENCH_BEGIN(BENCH_RESPONSE_LATEST);
+    gh_respond(0, "{\"latest\": 1}");
+    BENCH_END(BENCH_RESPONSE_LATEST);
+    BENCH_BEGIN(BENCH_RESPONSE_PACKED);
+    gh_respond(0, "{\"packed\": 0}");
+    BENCH_END(BENCH_RESPONSE_PACKED);
+    BENCH_BEGIN(BENCH_RESPONSE_LAYOUT);
+    gh_respond(0, "{\"layout\": 1}");
+    BENCH_END(BENCH_RESPONSE_LAYOUT);
+  }
+}
+
+static void bench_lcd(void) {
+  lcd_init();
+  for (uint8_t i = 0; i < BENCH_RUNS_NUM; ++i) {
+    lcd_text(i & 1 ? "benchmark odd" : "benchmark even", i & 1 ? '-' : '+');
+    BENCH_BEGIN(BENCH_LCD_FLUSH);
+    lcd_flush();
+    BENCH_END(BENCH_LCD_FLUSH);
+    lcd_locate_char(i & 3, i, '#');
+    BENCH_BEGIN(BENCH_LCD_ROUTINE);
+    lcd_routine();
+    BENCH_END(BENCH_LCD_ROUTINE);
+  }
+}
+
+int main(void) {
+  for (uint8_t i = 0; i < BENCH_RUNS_NUM; ++i) {
+    BENCH_BEGIN(BENCH_CALIBRATE);
+    BENCH_END(BENCH_CALIBRATE);
+  }
+  /* NOTE: Timer0 keeps interrupting from here on, its latency is sampled
+   *       across all benchmarks.
+   */
+  timer_init();
+  bench_gpio();
+  bench_dht11();
+  bench_storage();
+  bench_response();
+  bench_lcd();
+  BENCH_BEGIN(BENCH_DONE);
+  cli();
+  sleep_enable();
+  sleep_cpu();
+  while (1) {
+  }
+}
@@ -0,0 +1,224 @@
+/**
+ * @file bench_run.c
+ * @brief Runs the benchmark firmware under simavr and reports its cycles
+ *
+ * Times the sections the firmware marks, see bench.h, plays a DHT11 on its
+ * data pin and samples the latency of every interrupt, from the flag being
+ * raised to its vector running.
+ *
+ * Usage: bench_run <bench.elf>
+ *
+ * Prints one JSON object per line, benchmarks first, then interrupts:
+ *   {"bench":"storage_get","runs":16,"min":..,"max":..,"avg":..}
+ *   {"vector":10,"count":..,"max":..,"hist":[..]}
+ * Cycles exclude the marker overhead measured by the calibrate section.
+ */
+
+#include "bench.h"
+#include <avr_ioport.h>
+#include <sim_avr.h>
+#include <sim_elf.h>
+#include <sim_interrupts.h>
+#include <sim_irq.h>
+#include <sim_time.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_MCU "atmega32"
+#define BENCH_FREQUENCY 16000000
+#define BENCH_CYCLES_MAX (BENCH_FREQUENCY * 60ULL)
+
+/* Latency histogram buckets of BENCH_HIST_STEP cycles, the last is open. */
+#define BENCH_HIST_STEP 4
+#define BENCH_HIST_NUM 16
+#define BENCH_VECTORS_NUM 32
+
+/* Pin and reading of the simulated DHT11, see hal/dht11.h. */
+#define BENCH_DHT11_PORT 'C'
+#define BENCH_DHT11_PIN 6
+#define BENCH_DHT11_HUMIDITY 45
+#define BENCH_DHT11_TEMPERATURE 23
+
+typedef struct {
+  uint32_t runs;
+  uint64_t min, max, total;
+  uint64_t begin; /* cycle of the open section, 0 if none */
+} bench_stat_t;
+
+typedef struct {
+  uint64_t pending; /* cycle the flag was raised, 0 if not pending */
+  uint32_t count;
+  uint64_t max;
+  uint32_t hist[BENCH_HIST_NUM];
+} bench_vector_t;
+
+static bench_stat_t g_stats[BENCH_IDS_NUM];
+static bench_vector_t g_vectors[BENCH_VECTORS_NUM];
+static int gb_done;
+
+/* DHT11 response as (level, microseconds) phases, built per transfer. */
+static struct {
+  uint8_t level;
+  uint16_t us;
+} g_dht11_phases[4 + 2 * 40 + 1];
+static uint8_t g_dht11_phases_num, g_dht11_phase;
+static uint8_t gb_dht11_output;
+static avr_irq_t *gp_dht11_pin;
+
+static void mark_write(avr_t *avr, avr_io_addr_t addr, uint8_t value,
+                       void *param) {
+  uint8_t id = value & ~BENCH_MARK_END;
+  if (id == BENCH_DONE) {
+    gb_done = 1;
+    return;
+  }
+  if (id >= BENCH_IDS_NUM) {
+    return;
+  }
+  bench_stat_t *p_stat = &g_stats[id];
+  if (!(value & BENCH_MARK_END)) {
+    p_stat->begin = avr->cycle;
+    return;
+  }
+  if (!p_stat->begin) {
+    return;
+  }
+  uint64_t cycles = avr->cycle - p_stat->begin;
+  p_stat->begin = 0;
+  if (!p_stat->runs || cycles < p_stat->min) {
+    p_stat->min = cycles;
+  }
+  if (cycles > p_stat->max) {
+    p_stat->max = cycles;
+  }
+  p_stat->total += cycles;
+  ++p_stat->runs;
+}
+
+static void vector_pending(avr_irq_t *irq, uint32_t vector, void *param) {
+  avr_t *avr = param;
+  if (vector < BENCH_VECTORS_NUM && !g_vectors[vector].pending) {
+    g_vectors[vector].pending = avr->cycle;
+  }
+}
+
+static void vector_running(avr_irq_t *irq, uint32_t vector, void *param) {
+  avr_t *avr = param;
+  if (vector >= BENCH_VECTORS_NUM || !g_vectors[vector].pending) {
+    return;
+  }
+  bench_vector_t *p_vector = &g_vectors[vector];
+  uint64_t latency = avr->cycle - p_vector->pending;
+  p_vector->pending = 0;
+  ++p_vector->count;
+  if (latency > p_vector->max) {
+    p_vector->max = latency;
+  }
+  uint64_t bucket = latency / BENCH_HIST_STEP;
+  ++p_vector->hist[bucket < BENCH_HIST_NUM ? bucket : BENCH_HIST_NUM - 1];
+}
+
+static void dht11_phase_add(uint8_t level, uint16_t us) {
+  g_dht11_phases[g_dht11_phases_num].level = level;
+  g_dht11_phases[g_dht11_phases_num++].us = us;
+}
+
+static avr_cycle_count_t dht11_step(avr_t *avr, avr_cycle_count_t when,
+                                    void *param) {
+  if (g_dht11_phase == g_dht11_phases_num) {
+    avr_raise_irq(gp_dht11_pin, 1); /* released, pulled up */
+    return 0;
+  }
+  avr_raise_irq(gp_dht11_pin, g_dht11_phases[g_dht11_phase].level);
+  return when +
+         avr_usec_to_cycles(avr, g_dht11_phases[g_dht11_phase++].us);
+}
+
+/* The host releases the line after its start pulse, the sensor answers. */
+static void dht11_direction(avr_irq_t *irq, uint32_t ddr, void *param) {
+  avr_t *avr = param;
+  uint8_t b_output = (ddr >> BENCH_DHT11_PIN) & 1;
+  if (gb_dht11_output && !b_output) {
+    uint8_t bytes[5] = {BENCH_DHT11_HUMIDITY, 0, BENCH_DHT11_TEMPERATURE, 0};
+    bytes[4] = bytes[0] + bytes[1] + bytes[2] + bytes[3];
+    g_dht11_phases_num = g_dht11_phase = 0;
+    dht11_phase_add(1, 30);
+    dht11_phase_add(0, 80);
+    dht11_phase_add(1, 80);
+    for (uint8_t bit = 0; bit < 40; ++bit) {
+      dht11_phase_add(0, 50);
+      dht11_phase_add(1, (bytes[bit / 8] >> (7 - bit % 8)) & 1 ? 70 : 26);
+    }
+    dht11_phase_add(0, 50);
+    avr_cycle_timer_register(avr, 1, dht11_step, NULL);
+  }
+  gb_dht11_output = b_output;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <bench.elf>\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  elf_firmware_t firmware = {0};
+  avr_t *avr = avr_make_mcu_by_name(BENCH_MCU);
+  if (elf_read_firmware(argv[1], &firmware) || avr == NULL) {
+    fprintf(stderr, "cannot load %s\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+  avr_init(avr);
+  avr_load_firmware(avr, &firmware);
+  avr->frequency = BENCH_FREQUENCY;
+
+  avr_register_io_write(avr, BENCH_MARK_ADDRESS, mark_write, NULL);
+  avr_irq_t *p_any = avr_get_interrupt_irq(avr, AVR_INT_ANY);
+  avr_irq_register_notify(p_any + AVR_INT_IRQ_PENDING, vector_pending, avr);
+  avr_irq_register_notify(p_any + AVR_INT_IRQ_RUNNING, vector_running, avr);
+  gp_dht11_pin = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(BENCH_DHT11_PORT),
+                               BENCH_DHT11_PIN);
+  avr_irq_register_notify(
+      avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(BENCH_DHT11_PORT),
+                    IOPORT_IRQ_DIRECTION_ALL),
+      dht11_direction, avr);
+  avr_raise_irq(gp_dht11_pin, 1);
+
+  int state = cpu_Running;
+  while (!gb_done && avr->cycle < BENCH_CYCLES_MAX && state != cpu_Done &&
+         state != cpu_Crashed) {
+    state = avr_run(avr);
+  }
+  if (!gb_done) {
+    fprintf(stderr, "benchmark did not finish, cycle %llu state %d\n",
+            (unsigned long long)avr->cycle, state);
+    return EXIT_FAILURE;
+  }
+
+  static const char *const names[] = BENCH_NAMES;
+  uint64_t overhead = g_stats[BENCH_CALIBRATE].min;
+  for (uint8_t id = 0; id < BENCH_IDS_NUM; ++id) {
+    bench_stat_t *p_stat = &g_stats[id];
+    if (!p_stat->runs) {
+      continue;
+    }
+    printf("{\"bench\":\"%s\",\"runs\":%u,\"min\":%llu,\"max\":%llu,"
+           "\"avg\":%llu}\n",
+           names[id], p_stat->runs,
+           (unsigned long long)(p_stat->min - overhead),
+           (unsigned long long)(p_stat->max - overhead),
+           (unsigned long long)(p_stat->total / p_stat->runs - overhead));
+  }
+  for (uint8_t vector = 0; vector < BENCH_VECTORS_NUM; ++vector) {
+    bench_vector_t *p_vector = &g_vectors[vector];
+    if (!p_vector->count) {
+      continue;
+    }
+    printf("{\"vector\":%u,\"count\":%u,\"max\":%llu,\"hist\":[", vector,
+           p_vector->count, (unsigned long long)p_vector->max);
+    for (uint8_t i = 0; i < BENCH_HIST_NUM; ++i) {
+      printf(i ? ",%u" : "%u", p_vector->hist[i]);
+    }
+    printf("]}\n");
+  }
+  return EXIT_SUCCESS;
+}
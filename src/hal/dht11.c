@@ -6,38 +6,116 @@
  */
 
 #include "dht11.h"
+#include "../mcal/profile.h"
+#include "../mcal/timer.h"
 #include "util/delay.h"
 #include <stddef.h>
 #include <stdint.h>
 
+/* Longest wait for an edge, every phase of the protocol is shorter. */
+#define DHT11_EDGE_TIMEOUT_US 100
+
+/* Sensor output of logic 0 is high for ~26-28us and of logic 1 for ~70us. */
+#define DHT11_BIT_THRESHOLD_US 48
+
+typedef struct {
+  uint8_t b_valid;
+  uint8_t temperature, humidity;
+  uint32_t sampled_ms; /* of the last good reading */
+  uint32_t tried_ms;   /* of the last transfer, good or not */
+} dht11_cache_t;
+
+static dht11_cache_t g_cache;
+
+GPIO_PIN_DEFINE(dht11_data, DHT11_PORT, DHT11_PIN)
+
+static dht11_status_t dht11_refresh(uint32_t now_ms);
+static dht11_status_t dht11_sample(uint8_t *p_temperature,
+                                   uint8_t *p_humidity);
+static dht11_status_t dht11_rx_edge(uint8_t *p_ticks,
+                                    uint8_t b_wait_for_rising_edge);
 static dht11_status_t dht11_rx_byte(uint8_t *p_data);
 
 /* -------- Interface Functions ---------- */
 dht11_status_t dht11_init(void) { return DHT11_OK; }
 
+dht11_status_t dht11_routine(void) {
+  uint32_t now_ms;
+  if (timer_get_ms(&now_ms) != TIMER_OK) {
+    return DHT11_ERROR;
+  }
+  if (now_ms - g_cache.tried_ms < DHT11_REFRESH_PERIOD_MS) {
+    return DHT11_OK;
+  }
+  return dht11_refresh(now_ms);
+}
+
 dht11_status_t dht11_read(uint8_t *p_temperature, uint8_t *p_humidity) {
-  if (p_temperature == NULL || p_humidity == NULL) {
+  PROFILE_SCOPE(PROFILE_DHT11_READ);
+  uint32_t now_ms;
+  if (p_temperature == NULL || p_humidity == NULL ||
+      timer_get_ms(&now_ms) != TIMER_OK) {
     return DHT11_ERROR;
   }
+  if (!g_cache.b_valid || now_ms - g_cache.sampled_ms > DHT11_MAX_AGE_MS) {
+    /* NOTE: Nothing to serve, sample now if the sensor allows it. */
+    if (now_ms - g_cache.tried_ms < DHT11_MIN_INTERVAL_MS ||
+        dht11_refresh(now_ms) != DHT11_OK) {
+      return DHT11_ERROR;
+    }
+  }
+  *p_temperature = g_cache.temperature;
+  *p_humidity = g_cache.humidity;
+  return DHT11_OK;
+}
+
+dht11_status_t dht11_get_age(uint32_t *p_age_ms) {
+  uint32_t now_ms;
+  if (p_age_ms == NULL || !g_cache.b_valid ||
+      timer_get_ms(&now_ms) != TIMER_OK) {
+    return DHT11_ERROR;
+  }
+  *p_age_ms = now_ms - g_cache.sampled_ms;
+  return DHT11_OK;
+}
+
+/* -------- Static Functions ---------- */
+static dht11_status_t dht11_refresh(uint32_t now_ms) {
+  uint8_t temperature, humidity;
+  /* NOTE: A failed transfer also counts towards the minimum interval and
+   *       keeps the previous good reading.
+   */
+  g_cache.tried_ms = now_ms;
+  if (dht11_sample(&temperature, &humidity) != DHT11_OK) {
+    return DHT11_ERROR;
+  }
+  g_cache.temperature = temperature;
+  g_cache.humidity = humidity;
+  g_cache.sampled_ms = now_ms;
+  g_cache.b_valid = 1;
+  return DHT11_OK;
+}
+
+static dht11_status_t dht11_sample(uint8_t *p_temperature,
+                                   uint8_t *p_humidity) {
   /* Transmit request pulse */
   /* NOTE: Pulling low is at least 18ms so that DHT11 is reset.
    */
-  gpio_set_pin_direction(DHT11_PORT, DHT11_PIN, 1);
+  dht11_data_set_direction(1);
   _delay_ms(18);
-  gpio_set_pin_level(DHT11_PORT, DHT11_PIN, 0);
+  dht11_data_set_low();
   _delay_ms(18); // at least 18ms to be detected
-  gpio_set_pin_direction(DHT11_PORT, DHT11_PIN, 0);
+  dht11_data_set_direction(0);
 
   /* Receive response pulse */
-  uint8_t b_is_high = 1;
-  while (b_is_high) {
-    gpio_get_pin_level(DHT11_PORT, DHT11_PIN, &b_is_high);
-  }
-  while (!b_is_high) {
-    gpio_get_pin_level(DHT11_PORT, DHT11_PIN, &b_is_high);
-  }
-  while (b_is_high) {
-    gpio_get_pin_level(DHT11_PORT, DHT11_PIN, &b_is_high);
+  /* NOTE: ~80us low then ~80us high, each edge is waited for separately so
+   *       that neither phase exceeds the timeout.
+   */
+  uint8_t ticks;
+  if (dht11_rx_edge(&ticks, 0) != DHT11_OK ||
+      dht11_rx_edge(&ticks, 1) != DHT11_OK ||
+      dht11_rx_edge(&ticks, 0) != DHT11_OK) {
+    return DHT11_ERROR;
   }
 
   /* Receive data */
@@ -72,45 +150,44 @@ dht11_status_t dht11_read(uint8_t *p_temperature, uint8_t *p_humidity) {
   return DHT11_OK;
 }
 
-/* -------- Static Functions ---------- */
-static inline dht11_status_t dht11_rx_edge(uint16_t *p_iter_count,
+/* NOTE: Phases are timed with Timer0 rather than by counting iterations,
+ *       since the pin reads compile down to a single instruction.
+ */
+static inline dht11_status_t dht11_rx_edge(uint8_t *p_ticks,
                                            uint8_t b_wait_for_rising_edge) {
-  uint8_t b_is_high = 0;
-  for (*p_iter_count = 0; *p_iter_count < 0xFF; ++(*p_iter_count)) {
-    gpio_get_pin_level(DHT11_PORT, DHT11_PIN, &b_is_high);
-    if (!!b_is_high == !!b_wait_for_rising_edge) {
-      break;
+  uint8_t start, now;
+  timer_get_ticks(&start);
+  do {
+    timer_get_ticks(&now);
+    /* Timer0 wraps every millisecond. */
+    *p_ticks = now >= start ? now - start : now + TIMER_TICKS_PER_MS - start;
+    if (*p_ticks > DHT11_EDGE_TIMEOUT_US / TIMER_US_PER_TICK) {
+      return DHT11_ERROR;
     }
-  }
-  if (*p_iter_count == 0xff) {
-    return DHT11_ERROR;
-  }
+  } while (dht11_data_is_high() != !!b_wait_for_rising_edge);
   return DHT11_OK;
 }
 
-static inline dht11_status_t dht11_rx_pulse(uint16_t *p_iter_count) {
-  if (dht11_rx_edge(p_iter_count, 1) != DHT11_OK) {
+static inline dht11_status_t dht11_rx_pulse(uint8_t *p_ticks) {
+  if (dht11_rx_edge(p_ticks, 1) != DHT11_OK) {
     return DHT11_ERROR;
   }
-  return dht11_rx_edge(p_iter_count, 0);
+  return dht11_rx_edge(p_ticks, 0);
 }
 
 static inline dht11_status_t dht11_rx_bit(uint8_t *pb_is_high) {
-  uint16_t iter_count;
-  if (dht11_rx_pulse(&iter_count) != DHT11_OK) {
+  uint8_t ticks;
+  if (dht11_rx_pulse(&ticks) != DHT11_OK) {
     return DHT11_ERROR;
   }
-  /* NOTE: Sensor output of logic 0 takes ~26-28us and
-   *       output of logic 1 takes ~70us.
-   */
-  *pb_is_high = iter_count >= 10;
+  *pb_is_high = ticks >= DHT11_BIT_THRESHOLD_US / TIMER_US_PER_TICK;
   return DHT11_OK;
 }
 
 static inline dht11_status_t dht11_rx_byte(uint8_t *p_data) {
   *p_data = 0;
   uint8_t b_is_high;
-  gpio_set_pin_level(DHT11_PORT, DHT11_PIN, 1);
+  dht11_data_set_high();
   for (int8_t bit = 7; bit >= 0; --bit) {
     if (dht11_rx_bit(&b_is_high) != DHT11_OK) {
       return DHT11_ERROR;
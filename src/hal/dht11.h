@@ -14,6 +14,15 @@
 #define DHT11_PORT GPIO_PORT_C
 #define DHT11_PIN GPIO_PIN_6
 
+/* DHT11 must not be sampled more often than once per second, nor within the
+ * first second after power up.
+ */
+#define DHT11_MIN_INTERVAL_MS 1000
+#define DHT11_REFRESH_PERIOD_MS 2000
+
+/* A cached reading older than that is not served. */
+#define DHT11_MAX_AGE_MS 30000
+
 typedef enum : uint8_t {
   DHT11_OK = 0,
   DHT11_ERROR = 1,
@@ -21,6 +30,13 @@ typedef enum : uint8_t {
 
 dht11_status_t dht11_init(void);
 
+/* Refreshes the cached reading when due, call it from the main loop. */
+dht11_status_t dht11_routine(void);
+
+/* Serves the cached reading without blocking. A missing or stale reading is
+ * sampled on demand instead, when the minimum interval allows it.
+ */
 dht11_status_t dht11_read(uint8_t *p_temperature, uint8_t *p_humidity);
+dht11_status_t dht11_get_age(uint32_t *p_age_ms);
 
 #endif /* DHT11_H */
@@ -13,6 +13,27 @@
 #include "ds1307.h"
 #include "../mcal/twi.h"
 
+/* Days Before Each Month Of a Non-Leap Year */
+static const uint16_t g_daysBeforeMonth[12] = {
+	0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334
+};
+
+static uint8_t bcdToBinary(uint8_t bcd)
+{
+	return (bcd >> 4) * 10 + (bcd & 0x0F);
+}
+
+static uint8_t binaryToBcd(uint8_t binary)
+{
+	return ((binary / 10) << 4) | (binary % 10);
+}
+
+/* Days Before a Month (1 To 12) Of a Year Since 2000 */
+static uint16_t daysBeforeMonth(uint8_t month, uint8_t year)
+{
+	return g_daysBeforeMonth[month - 1] + (month > 2 && (year % 4) == 0);
+}
+
 uint8_t RTC_setTime(RTC_Time_t time)
 {
 	uint8_t i;/* Loop Iterator */
@@ -93,3 +114,54 @@ uint8_t RTC_getTime(RTC_Time_t *time)
 
     return RTC_SUCCESS;
 }
+
+uint32_t RTC_toEpoch(const RTC_Time_t *time)
+{
+	/* Clock Halt And 12-hour Mode Bits Are Masked Out */
+	uint8_t year = bcdToBinary(time->time.year);
+	uint8_t month = bcdToBinary(time->time.month & 0x1F);
+	uint8_t hours = bcdToBinary(time->time.hours & 0x3F);
+	uint32_t days;
+
+	if (month < 1 || month > 12)
+		return 0;
+
+	/* Every Year Divisible By 4 Is Leap Between 2000 And 2099 */
+	days = 365UL * year + (year + 3) / 4 + g_daysBeforeMonth[month - 1]
+			+ bcdToBinary(time->time.dayOfMonth) - 1;
+	if (month > 2 && (year % 4) == 0)
+		days++;
+
+	return ((days * 24 + hours) * 60 + bcdToBinary(time->time.minutes)) * 60
+			+ bcdToBinary(time->time.seconds & 0x7F);
+}
+
+uint8_t RTC_fromEpoch(uint32_t epoch, RTC_Time_t *time)
+{
+	uint32_t days = epoch / 86400UL;
+	uint32_t seconds = epoch % 86400UL;
+	uint8_t year = 0;
+	uint8_t month = 1;
+
+	/* 2000-01-01 Was a Saturday, Days Of The Week Count From Sunday As 1 */
+	time->time.dayOfWeek = (days + 6) % 7 + 1;
+
+	while (days >= ((year % 4) ? 365U : 366U))
+	{
+		days -= (year % 4) ? 365U : 366U;
+		year++;
+	}
+	if (year > 99)
+		return RTC_ERROR;
+	while (month < 12 && daysBeforeMonth(month + 1, year) <= days)
+		month++;
+
+	time->time.year = binaryToBcd(year);
+	time->time.month = binaryToBcd(month);
+	time->time.dayOfMonth = binaryToBcd(days - daysBeforeMonth(month, year) + 1);
+	time->time.hours = binaryToBcd(seconds / 3600);
+	time->time.minutes = binaryToBcd(seconds / 60 % 60);
+	time->time.seconds = binaryToBcd(seconds % 60);
+
+	return RTC_SUCCESS;
+}
@@ -56,4 +56,18 @@ uint8_t RTC_setTime(RTC_Time_t time);
  */
 uint8_t RTC_getTime(RTC_Time_t *time);
 
+
+/*
+ * Description :
+ * a Function To Convert a 24-hour RTC Time To Seconds Since 2000-01-01 00:00:00
+ */
+uint32_t RTC_toEpoch(const RTC_Time_t *time);
+
+
+/*
+ * Description :
+ * a Function To Convert Seconds Since 2000-01-01 00:00:00 To a 24-hour RTC Time
+ */
+uint8_t RTC_fromEpoch(uint32_t epoch, RTC_Time_t *time);
+
 #endif
@@ -0,0 +1,172 @@
+ /******************************************************************************
+ *
+ * Module: EEPROM24
+ *
+ * File Name: eeprom24.c
+ *
+ * Description: Source file for the 24LCxx I2C EEPROM / FM24 I2C FRAM driver
+ *******************************************************************************/
+
+#include "eeprom24.h"
+#include "../mcal/twi.h"
+#include <stddef.h>
+
+/* Sends Start, Device Address For Writing And The Two Address Bytes, The
+ * Caller Sends The Stop Bit Whatever The Result */
+static uint8_t EEPROM24_select(uint32_t address)
+{
+	/* Send Start bit */
+	TWI_start();
+	if (TWI_getStatus() != TWI_START)
+		return EEPROM24_ERROR;
+
+	/* Send Device Address with R/W = 0 (write) */
+	TWI_writeByte(EEPROM24_TWI_ADDRESS);
+	if (TWI_getStatus() != TWI_MT_SLA_W_ACK)
+		return EEPROM24_ERROR;
+
+	/* Send The Required Memory Address, High Byte First */
+	TWI_writeByte((uint8_t)(address >> 8));
+	if (TWI_getStatus() != TWI_MT_DATA_ACK)
+		return EEPROM24_ERROR;
+	TWI_writeByte((uint8_t)address);
+	if (TWI_getStatus() != TWI_MT_DATA_ACK)
+		return EEPROM24_ERROR;
+
+	return EEPROM24_SUCCESS;
+}
+
+/* Waits For The Internal Write Cycle, The Device Does Not Acknowledge Its
+ * Address Until It Is Done */
+static uint8_t EEPROM24_waitReady(void)
+{
+#if EEPROM24_IS_FRAM
+	return EEPROM24_SUCCESS;
+#else
+	uint16_t attempt;/* Loop Iterator */
+
+	for (attempt = 0; attempt < EEPROM24_POLL_ATTEMPTS; attempt++)
+	{
+		TWI_start();
+		TWI_writeByte(EEPROM24_TWI_ADDRESS);
+		if (TWI_getStatus() == TWI_MT_SLA_W_ACK)
+		{
+			TWI_stop();
+			return EEPROM24_SUCCESS;
+		}
+	}
+	TWI_stop();
+	return EEPROM24_ERROR;
+#endif
+}
+
+/* Writes Bytes Not Crossing a Page Boundary, Or a Fill Byte When data Is NULL */
+static uint8_t EEPROM24_writePage(uint32_t address, const uint8_t *data,
+		uint16_t size)
+{
+	uint16_t i;/* Loop Iterator */
+	uint8_t status = EEPROM24_select(address);
+
+	for (i = 0; status == EEPROM24_SUCCESS && i < size; i++)
+	{
+		TWI_writeByte(data != NULL ? data[i] : 0xFF);
+		if (TWI_getStatus() != TWI_MT_DATA_ACK)
+			status = EEPROM24_ERROR;
+	}
+
+	/* Send the Stop Bit, It Starts The Write Cycle Or Frees The Bus */
+	TWI_stop();
+
+	if (status != EEPROM24_SUCCESS)
+		return EEPROM24_ERROR;
+
+	return EEPROM24_waitReady();
+}
+
+static uint8_t EEPROM24_writePages(uint32_t address, const uint8_t *data,
+		uint16_t size)
+{
+	uint16_t chunk;
+
+	if (address + size > EEPROM24_SIZE)
+		return EEPROM24_ERROR;
+
+	while (size > 0)
+	{
+		/* Bytes Left Until The End Of The Current Page */
+		chunk = EEPROM24_PAGE_SIZE - (address % EEPROM24_PAGE_SIZE);
+		if (chunk > size)
+			chunk = size;
+
+		if (EEPROM24_writePage(address, data, chunk) != EEPROM24_SUCCESS)
+			return EEPROM24_ERROR;
+
+		address += chunk;
+		size -= chunk;
+		if (data != NULL)
+			data += chunk;
+	}
+
+	return EEPROM24_SUCCESS;
+}
+
+/* Reads From The Address Sent By EEPROM24_select, Leaves The Stop Bit To
+ * The Caller */
+static uint8_t EEPROM24_readSelected(uint8_t *data, uint16_t size)
+{
+	uint16_t i;/* Loop Iterator */
+
+	/* Send the Repeated Start Bit */
+	TWI_start();
+	if (TWI_getStatus() != TWI_REP_START)
+		return EEPROM24_ERROR;
+
+	/* Send Device Address with R/W = 1 (Read) */
+	TWI_writeByte(EEPROM24_TWI_ADDRESS | 0x01);
+	if (TWI_getStatus() != TWI_MT_SLA_R_ACK)
+		return EEPROM24_ERROR;
+
+	/* Sequential Read, Every Byte But The Last Is Acknowledged */
+	for (i = 0; i < size - 1; i++)
+	{
+		data[i] = TWI_readByteWithACK();
+		if (TWI_getStatus() != TWI_MR_DATA_ACK)
+			return EEPROM24_ERROR;
+	}
+
+	data[i] = TWI_readByteWithNACK();
+	if (TWI_getStatus() != TWI_MR_DATA_NACK)
+		return EEPROM24_ERROR;
+
+	return EEPROM24_SUCCESS;
+}
+
+uint8_t EEPROM24_read(uint32_t address, uint8_t *data, uint16_t size)
+{
+	uint8_t status;
+
+	if (data == NULL || size == 0 || address + size > EEPROM24_SIZE)
+		return EEPROM24_ERROR;
+
+	status = EEPROM24_select(address);
+	if (status == EEPROM24_SUCCESS)
+		status = EEPROM24_readSelected(data, size);
+
+	/* Send the Stop Bit, Also After a Failure So The Bus Is Free */
+	TWI_stop();
+
+	return status;
+}
+
+uint8_t EEPROM24_write(uint32_t address, const uint8_t *data, uint16_t size)
+{
+	if (data == NULL)
+		return EEPROM24_ERROR;
+
+	return EEPROM24_writePages(address, data, size);
+}
+
+uint8_t EEPROM24_erase(uint32_t address, uint16_t size)
+{
+	return EEPROM24_writePages(address, NULL, size);
+}
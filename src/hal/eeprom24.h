@@ -0,0 +1,59 @@
+ /******************************************************************************
+ *
+ * Module: EEPROM24
+ *
+ * File Name: eeprom24.h
+ *
+ * Description: Header file for the 24LCxx I2C EEPROM / FM24 I2C FRAM driver
+ *******************************************************************************/
+
+#ifndef EEPROM24_H_
+#define EEPROM24_H_
+
+#include <stdint.h>
+
+/*******************************************************************************
+ * 									macros
+ *******************************************************************************/
+/* Device Address With A2..A0 Tied Low */
+#define EEPROM24_TWI_ADDRESS					0b10100000
+
+/* Memory Size In Bytes, Devices With Two Address Bytes (24LC32 Up To 24LC512,
+ * FM24C64 Up To FM24V05) */
+#define EEPROM24_SIZE							32768UL
+
+/* Page Size Of The Device, Writes Never Cross a Page Boundary */
+#define EEPROM24_PAGE_SIZE						64
+
+/* Set To 1 For FRAM, Which Writes Without Delay So No Polling Is Needed */
+#define EEPROM24_IS_FRAM						0
+
+/* Attempts To Poll The Device Until It Finishes a Write Cycle (~5ms) */
+#define EEPROM24_POLL_ATTEMPTS					1000
+
+#define EEPROM24_ERROR 							0
+#define EEPROM24_SUCCESS 						1
+
+/*******************************************************************************
+ *                      	 Functions Prototypes                              *
+ *******************************************************************************/
+/*
+ * Description :
+ * a Function To Read a Sequence Of Bytes Starting From a Memory Address
+ */
+uint8_t EEPROM24_read(uint32_t address, uint8_t *data, uint16_t size);
+
+/*
+ * Description :
+ * a Function To Write a Sequence Of Bytes Starting From a Memory Address,
+ * Split Into Page Writes
+ */
+uint8_t EEPROM24_write(uint32_t address, const uint8_t *data, uint16_t size);
+
+/*
+ * Description :
+ * a Function To Fill a Sequence Of Bytes With 0xFF
+ */
+uint8_t EEPROM24_erase(uint32_t address, uint16_t size);
+
+#endif
@@ -6,24 +6,47 @@
  */
 
 #include "esp01.h"
+#include "../mcal/timer.h"
 #include "../mcal/usart.h"
+#include <avr/pgmspace.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <util/atomic.h>
 
 #define END(array) (array + sizeof(array))
 #define ABS(data) ((data) < 0 ? -(data) : (data))
+#define STR(token) #token
+#define XSTR(token) STR(token)
 
 static volatile uint8_t g_rx_buf[ESP01_RX_BUF_SIZE], *gp_rx_buf_itr;
 static volatile uint8_t gb_rx_buf_overflow;
-static const char *(*gh_respond)(const char *) = NULL;
+static const char *(*gh_respond)(uint8_t, const char *) = NULL;
+static uint16_t g_drops;
+static uint16_t g_tx_timeouts;
 static void esp01_rx_complete_isr(void);
 
+/* NOTE: The rest of a string is not sent once CTS stays held past the
+ *       timeout, the module is left with a cut line the caller fails on.
+ */
 static esp01_status_t esp01_tx_str(const char *str) {
   for (; *str; ++str) {
-    usart_tx(*str);
+    if (usart_tx(*str) != USART_OK) {
+      ++g_tx_timeouts;
+      return ESP01_ERROR;
+    }
+  }
+  return ESP01_OK;
+}
+
+static esp01_status_t esp01_tx_str_P(const char *str_P) {
+  for (char c; (c = pgm_read_byte(str_P)); ++str_P) {
+    if (usart_tx(c) != USART_OK) {
+      ++g_tx_timeouts;
+      return ESP01_ERROR;
+    }
   }
   return ESP01_OK;
 }
@@ -49,15 +72,54 @@ static esp01_status_t esp01_parse_g_buf(void) {
   if (gb_rx_buf_overflow) {
     return ESP01_DROP;
   }
-  if (strstr((char *)g_rx_buf, "\r\nOK\r\n") != NULL) {
+  if (strstr_P((char *)g_rx_buf, PSTR("\r\nOK\r\n")) != NULL) {
     return ESP01_OK;
   }
-  if (strstr((char *)g_rx_buf, "\r\nERROR\r\n") != NULL) {
+  if (strstr_P((char *)g_rx_buf, PSTR("\r\nERROR\r\n")) != NULL) {
     return ESP01_ERROR;
   }
   return ESP01_DROP;
 }
 
+/* Receives the reply to a command and parses it. Unlike esp01_rx_g_buf(),
+ * it does not stop at a gap, as the module may think a while before it
+ * answers, but as soon as a line completes the reply.
+ */
+static esp01_status_t esp01_rx_reply(uint16_t timeout_ms) {
+  uint32_t start_ms, now_ms;
+  timer_get_ms(&start_ms);
+  gb_rx_buf_overflow = 0;
+  gp_rx_buf_itr = g_rx_buf;
+  while (gp_rx_buf_itr != END(g_rx_buf) - 1) {
+    if (usart_rx((uint8_t *)gp_rx_buf_itr) == USART_RX_TIMEOUT) {
+      timer_get_ms(&now_ms);
+      if (now_ms - start_ms >= timeout_ms) {
+        break;
+      }
+      continue;
+    }
+    /* NOTE: Replies are parsed at line ends only, OK and ERROR end one. */
+    if (*gp_rx_buf_itr++ == '\n') {
+      *gp_rx_buf_itr = '\0';
+      esp01_status_t status = esp01_parse_g_buf();
+      if (status != ESP01_DROP) {
+        return status;
+      }
+    }
+  }
+  *gp_rx_buf_itr = '\0';
+  gb_rx_buf_overflow = gp_rx_buf_itr == END(g_rx_buf) - 1;
+  return esp01_parse_g_buf();
+}
+
+/* Sends a command from flash and receives its reply. */
+static esp01_status_t esp01_command_P(const char *str_P, uint16_t timeout_ms) {
+  if (esp01_tx_str_P(str_P) != ESP01_OK) {
+    return ESP01_ERROR;
+  }
+  return esp01_rx_reply(timeout_ms);
+}
+
 static esp01_status_t esp01_init(void) {
   if (usart_init(ESP01_BAUD_RATE, USART_PARITY_NONE, 0, 0, 0, 0, 0, 0, 0) !=
           USART_OK ||
@@ -66,8 +128,8 @@ static esp01_status_t esp01_init(void) {
   }
   return ESP01_OK;
 }
-esp01_status_t esp01_init_as_access_point(const char *str_ssid,
-                                          const char *str_pass) {
+esp01_status_t esp01_init_as_access_point(const char *str_ssid_P,
+                                          const char *str_pass_P) {
   esp01_status_t status = esp01_init();
   if (status != ESP01_OK) {
     return status;
@@ -75,46 +137,60 @@ esp01_status_t esp01_init_as_access_point(const char *str_ssid,
   if (gh_respond != NULL) {
     return ESP01_DROP;
   }
-  esp01_tx_str("AT+CWMODE=2\r\n");
-  esp01_rx_g_buf();
-  status = esp01_parse_g_buf();
+#ifdef USART_FLOW_CONTROL
+  /* NOTE: Not stored in the module flash, it boots without flow control. */
+  status = esp01_command_P(
+      PSTR("AT+UART_CUR=" XSTR(ESP01_BAUD_RATE) ",8,1,0,3\r\n"),
+      ESP01_REPLY_TIMEOUT_MS);
+  if (status != ESP01_OK) {
+    return status;
+  }
+#endif
+  status = esp01_command_P(PSTR("AT+CWMODE=2\r\n"), ESP01_REPLY_TIMEOUT_MS);
   if (status != ESP01_OK) {
     return status;
   }
 
-  esp01_tx_str("AT+CWSAP=");
-  esp01_tx_str("\"");
-  esp01_tx_str(str_ssid);
-  esp01_tx_str("\",\"");
-  esp01_tx_str(str_pass);
-  esp01_tx_str("\",11,4\r\n");
-  esp01_rx_g_buf();
-  return esp01_parse_g_buf();
+  if (esp01_tx_str_P(PSTR("AT+CWSAP=\"")) != ESP01_OK ||
+      esp01_tx_str_P(str_ssid_P) != ESP01_OK ||
+      esp01_tx_str_P(PSTR("\",\"")) != ESP01_OK ||
+      esp01_tx_str_P(str_pass_P) != ESP01_OK) {
+    return ESP01_ERROR;
+  }
+  return esp01_command_P(PSTR("\",11,4\r\n"), ESP01_REPLY_TIMEOUT_MS);
 }
 
-esp01_status_t esp01_run_server(const char *str_port,
-                                const char *(*h_respond)(const char *)) {
+esp01_status_t esp01_run_server(const char *str_port_P,
+                                const char *(*h_respond)(uint8_t link_id,
+                                                         const char *)) {
   if (h_respond == NULL) {
     return ESP01_ERROR;
   }
 
   gh_respond = h_respond;
 
-  esp01_tx_str("AT+CIPMUX=1\r\n");
-  esp01_rx_g_buf();
-  esp01_status_t status = esp01_parse_g_buf();
+  esp01_status_t status =
+      esp01_command_P(PSTR("AT+CIPMUX=1\r\n"), ESP01_REPLY_TIMEOUT_MS);
+  if (status != ESP01_OK) {
+    return status;
+  }
+
+  if (esp01_tx_str_P(PSTR("AT+CIPSERVER=1,")) != ESP01_OK ||
+      esp01_tx_str_P(str_port_P) != ESP01_OK) {
+    return ESP01_ERROR;
+  }
+  status = esp01_command_P(PSTR("\r\n"), ESP01_REPLY_TIMEOUT_MS);
   if (status != ESP01_OK) {
     return status;
   }
 
-  esp01_tx_str("AT+CIPSERVER=1,");
-  esp01_tx_str(str_port);
-  esp01_tx_str("\r\n");
-  esp01_rx_g_buf();
+  status = esp01_command_P(
+      PSTR("AT+CIPSTO=" ESP01_SERVER_TIMEOUT_S_STR "\r\n"),
+      ESP01_REPLY_TIMEOUT_MS);
 
   usart_configure_isr(esp01_rx_complete_isr, NULL, NULL);
 
-  return esp01_parse_g_buf();
+  return status;
 }
 
 esp01_status_t esp01_kill_server(void) {
@@ -123,67 +199,169 @@ esp01_status_t esp01_kill_server(void) {
   }
   usart_configure_isr(NULL, NULL, NULL);
   gh_respond = NULL;
-  esp01_tx_str("AT+CIPSERVER=0\r\n");
-  esp01_rx_g_buf();
-  return esp01_parse_g_buf();
+  return esp01_command_P(PSTR("AT+CIPSERVER=0\r\n"),
+                         ESP01_REPLY_TIMEOUT_MS);
 }
 
-inline static esp01_status_t esp01_server_routine(void) {
-  if (esp01_rx_g_buf() == ESP01_DROP) {
-    return ESP01_DROP;
+esp01_status_t esp01_probe(void) {
+  if (gh_respond == NULL && esp01_init() != ESP01_OK) {
+    return ESP01_ERROR;
+  }
+  /* NOTE: The reply must not reach the server routine. */
+  usart_configure_isr(NULL, NULL, NULL);
+  esp01_status_t status =
+      esp01_command_P(PSTR("AT\r\n"), ESP01_PROBE_TIMEOUT_MS);
+  if (gh_respond != NULL) {
+    usart_configure_isr(esp01_rx_complete_isr, NULL, NULL);
   }
+  return status;
+}
 
-  if (gp_rx_buf_itr == g_rx_buf) {
-    return ESP01_OK;
+static esp01_status_t esp01_serve_g_buf(void);
+
+static esp01_status_t esp01_tx_cipsend(uint8_t id, const char *str) {
+  uint8_t len = strlen(str);
+  char str_buf[10];
+  sprintf_P(str_buf, PSTR("%i,%i"), id, len);
+
+  if (esp01_tx_str_P(PSTR("AT+CIPSEND=")) != ESP01_OK ||
+      esp01_tx_str(str_buf) != ESP01_OK ||
+      esp01_tx_str_P(PSTR("\r\n")) != ESP01_OK ||
+      esp01_rx_g_buf() != ESP01_OK || strchr((char *)g_rx_buf, '>') == NULL) {
+    return ESP01_ERROR;
+  }
+  /* NOTE: A request that came with the prompt is overwritten by the reply
+   *       to the send, one that comes with that reply is left for the caller.
+   */
+  if (strstr_P((char *)g_rx_buf, PSTR("+IPD")) != NULL) {
+    ++g_drops;
   }
 
-  if (strstr((char *)g_rx_buf, "CLOSED\r\n") == NULL &&
-      strstr((char *)g_rx_buf, "CONNECT\r\n") == NULL) {
-    return ESP01_DROP;
+  if (esp01_tx_str(str) != ESP01_OK ||
+      esp01_tx_str_P(PSTR("\r\n")) != ESP01_OK) {
+    return ESP01_ERROR;
   }
 
-  char *p_str_ipd = strstr((char *)g_rx_buf, "+IPD");
-  if (p_str_ipd == NULL) {
-    return ESP01_OK;
+  return esp01_rx_g_buf();
+}
+
+esp01_status_t esp01_push(uint8_t link_mask, const char *(*h_message)(void),
+                          uint8_t *p_failed_mask) {
+  if (gh_respond == NULL || h_message == NULL) {
+    return ESP01_ERROR;
   }
 
-  char *p_id_iter = strchr(p_str_ipd, ',') + 1;
-  char *p_len_iter = strchr(p_id_iter, ',') + 1;
-  char *p_data_iter = strchr(p_len_iter, ':') + 1;
+  /* NOTE: The RX interrupt runs the server routine, so it is masked while
+   *       the message is built and sent. A request arriving meanwhile comes
+   *       with a CIPSEND reply and is answered here.
+   */
+  usart_configure_isr(NULL, NULL, NULL);
 
-  *(p_data_iter - 1) = '\0';
-  uint8_t len = atoi(p_len_iter);
+  uint8_t failed_mask = 0;
+  const char *message = NULL;
+  for (uint8_t id = 0; id < ESP01_LINKS_NUM; ++id) {
+    if (!(link_mask & (1 << id))) {
+      continue;
+    }
+    if (message == NULL) {
+      message = h_message();
+    }
+    if (message == NULL || *message == '\0') {
+      failed_mask |= 1 << id;
+      continue;
+    }
+    if (esp01_tx_cipsend(id, message) != ESP01_OK) {
+      failed_mask |= 1 << id;
+    }
+    if (strstr_P((char *)g_rx_buf, PSTR("+IPD")) != NULL) {
+      if (esp01_serve_g_buf() != ESP01_OK) {
+        ++g_drops;
+      }
+      usart_hold_rx(0);
+      message = NULL; // the answer may have taken its buffer, built again
+    }
+  }
 
-  *(p_len_iter - 1) = '\0';
-  uint8_t id = atoi(p_id_iter);
+  usart_configure_isr(esp01_rx_complete_isr, NULL, NULL);
 
-  if (len > ABS((char *)END(g_rx_buf) - (char *)p_data_iter)) {
-    return ESP01_DROP;
+  if (p_failed_mask != NULL) {
+    *p_failed_mask = failed_mask;
   }
+  return failed_mask ? ESP01_DROP : ESP01_OK;
+}
 
-  *(p_data_iter + len) = '\0';
+/* Answers the request in g_rx_buf, if any. The reply to its CIPSEND is read
+ * into g_rx_buf, a request that came with it is answered in turn.
+ */
+static esp01_status_t esp01_serve_g_buf(void) {
+  char *p_str_ipd;
+  while ((p_str_ipd = strstr_P((char *)g_rx_buf, PSTR("+IPD"))) != NULL) {
+    char *p_id_iter = strchr(p_str_ipd, ',') + 1;
+    char *p_len_iter = strchr(p_id_iter, ',') + 1;
+    char *p_data_iter = strchr(p_len_iter, ':') + 1;
 
-  const char *replay = gh_respond(p_data_iter);
-  uint8_t replay_len = strlen(replay);
+    *(p_data_iter - 1) = '\0';
+    uint8_t len = atoi(p_len_iter);
 
-  if (!replay_len) {
-    return ESP01_OK;
+    *(p_len_iter - 1) = '\0';
+    uint8_t id = atoi(p_id_iter);
+
+    if (len > ABS((char *)END(g_rx_buf) - (char *)p_data_iter)) {
+      return ESP01_DROP;
+    }
+
+    *(p_data_iter + len) = '\0';
+
+    /* NOTE: Replies are still read, the next request waits in the module. */
+    usart_hold_rx(1);
+    const char *replay = gh_respond(id, p_data_iter);
+
+    if (!*replay) {
+      return ESP01_OK;
+    }
+
+    esp01_status_t status = esp01_tx_cipsend(id, replay);
+    if (status != ESP01_OK) {
+      return status;
+    }
   }
+  return ESP01_OK;
+}
 
-  char str_buf[10];
-  sprintf(str_buf, "%i,%i", id, replay_len);
+inline static esp01_status_t esp01_server_routine(void) {
+  if (esp01_rx_g_buf() == ESP01_DROP) {
+    return ESP01_DROP;
+  }
 
-  esp01_tx_str("AT+CIPSEND=");
-  esp01_tx_str(str_buf);
-  esp01_tx_str("\r\n");
-  if (esp01_rx_g_buf() != ESP01_OK) {
-    return ESP01_ERROR;
+  if (gp_rx_buf_itr == g_rx_buf) {
+    return ESP01_OK;
   }
 
-  esp01_tx_str(replay);
-  esp01_tx_str("\r\n");
+  return esp01_serve_g_buf();
+}
 
-  return esp01_rx_g_buf();
+static void esp01_rx_complete_isr(void) {
+  if (esp01_server_routine() != ESP01_OK) {
+    ++g_drops;
+  }
+  usart_hold_rx(0);
 }
 
-static void esp01_rx_complete_isr(void) { esp01_server_routine(); }
+esp01_status_t esp01_get_stats(esp01_stats_t *p_stats) {
+  usart_counters_t counters;
+  if (p_stats == NULL || usart_get_counters(&counters) != USART_OK) {
+    return ESP01_ERROR;
+  }
+  p_stats->overruns = counters.overruns;
+  p_stats->frame_errors = counters.frame_errors;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    p_stats->drops = g_drops;
+    p_stats->tx_timeouts = g_tx_timeouts;
+  }
+#ifdef USART_FLOW_CONTROL
+  p_stats->b_flow_control = 1;
+#else
+  p_stats->b_flow_control = 0;
+#endif
+  return ESP01_OK;
+}
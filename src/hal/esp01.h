@@ -15,16 +15,50 @@
 
 #define ESP01_BAUD_RATE 9600
 
+/* Longest a command is waited for, a reply ending with OK or ERROR ends the
+ * wait right away. A call chains 3 commands at most, which stays within the
+ * watchdog timeout as long as callers feed it between calls.
+ */
+#define ESP01_REPLY_TIMEOUT_MS 500
+
+/* Longest an AT probe is waited for, e.g. while the module boots. */
+#define ESP01_PROBE_TIMEOUT_MS 100
+
+/* Idle seconds before the module closes a link, 0 to 7200 (0 never closes).
+ * Long enough for held links to outlive a sampling period.
+ */
+#define ESP01_SERVER_TIMEOUT_S_STR "7200"
+
+/* Multiple connections mode serves link ids 0 to 4. */
+#define ESP01_LINKS_NUM 5
+
 typedef enum : uint8_t {
   ESP01_OK = 0,
   ESP01_ERROR,
   ESP01_DROP,
 } esp01_status_t;
 
-esp01_status_t esp01_init_as_access_point(const char *str_ssid,
-                                          const char *str_pass);
-esp01_status_t esp01_run_server(const char *str_port,
-                                const char *(*h_respond)(const char *));
+/* Losses on the link since reset, the counters wrap. */
+typedef struct {
+  uint16_t overruns;      /* bytes the UART lost */
+  uint16_t frame_errors;  /* bytes the UART garbled */
+  uint16_t drops;         /* requests that could not be answered */
+  uint16_t tx_timeouts;   /* sends cut short, CTS stayed held too long */
+  uint8_t b_flow_control; /* built with USART_FLOW_CONTROL */
+} esp01_stats_t;
+
+/* NOTE: Strings suffixed _P are in flash, e.g. PSTR("12345"). */
+esp01_status_t esp01_init_as_access_point(const char *str_ssid_P,
+                                          const char *str_pass_P);
+esp01_status_t esp01_run_server(const char *str_port_P,
+                                const char *(*h_respond)(uint8_t link_id,
+                                                         const char *));
+esp01_status_t esp01_push(uint8_t link_mask, const char *(*h_message)(void),
+                          uint8_t *p_failed_mask);
 esp01_status_t esp01_kill_server(void);
 
+/* Sends AT once, it sets the UART up first if the server does not run. */
+esp01_status_t esp01_probe(void);
+esp01_status_t esp01_get_stats(esp01_stats_t *p_stats);
+
 #endif /* ESP01_H */
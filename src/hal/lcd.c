@@ -6,6 +6,7 @@
  */
 
 #include "lcd.h"
+#include <avr/pgmspace.h>
 #include <stdint.h>
 #include <util/delay.h>
 
@@ -13,41 +14,164 @@
 #define LCD_COLS_NUM 20
 #define LCD_CUSTOM_CHARS_NUM 8
 
-inline static void lcd_data(uint8_t data) {
-  gpio_set_pin_level(LCD_PORT_DATA, LCD_PIN_D4, data & 0x10);
-  gpio_set_pin_level(LCD_PORT_DATA, LCD_PIN_D5, data & 0x20);
-  gpio_set_pin_level(LCD_PORT_DATA, LCD_PIN_D6, data & 0x40);
-  gpio_set_pin_level(LCD_PORT_DATA, LCD_PIN_D7, data & 0x80);
+/* Shadow of the display, writes land here and only the cells that changed
+ * are sent by lcd_routine() or lcd_flush().
+ */
+static char g_frame[LCD_ROWS_NUM][LCD_COLS_NUM];
+static uint32_t g_dirty_cols[LCD_ROWS_NUM];
+static uint8_t g_cursor_row, g_cursor_col;
 
-  gpio_set_pin_level(LCD_PORT_CONTROL, LCD_PIN_EN, 0);
-  _delay_us(40);
-  gpio_set_pin_level(LCD_PORT_CONTROL, LCD_PIN_EN, 1);
-  _delay_us(1);
+static const lcd_command_t g_line_commands[LCD_ROWS_NUM] = {
+    LCD_SET_DDRAM_LINE_0,
+    LCD_SET_DDRAM_LINE_1,
+    LCD_SET_DDRAM_LINE_2,
+    LCD_SET_DDRAM_LINE_3,
+};
+
+GPIO_PIN_DEFINE(lcd_rs, LCD_PORT_CONTROL, LCD_PIN_RS)
+GPIO_PIN_DEFINE(lcd_en, LCD_PORT_CONTROL, LCD_PIN_EN)
+#ifdef LCD_PIN_RW
+GPIO_PIN_DEFINE(lcd_rw, LCD_PORT_CONTROL, LCD_PIN_RW)
+#endif
+GPIO_PIN_DEFINE(lcd_d4, LCD_PORT_DATA, LCD_PIN_D4)
+GPIO_PIN_DEFINE(lcd_d5, LCD_PORT_DATA, LCD_PIN_D5)
+GPIO_PIN_DEFINE(lcd_d6, LCD_PORT_DATA, LCD_PIN_D6)
+GPIO_PIN_DEFINE(lcd_d7, LCD_PORT_DATA, LCD_PIN_D7)
+
+#define LCD_DATA_MASK                                                          \
+  ((1 << LCD_PIN_D4) | (1 << LCD_PIN_D5) | (1 << LCD_PIN_D6) |                 \
+   (1 << LCD_PIN_D7))
 
-  gpio_set_pin_level(LCD_PORT_DATA, LCD_PIN_D4, data & 0x01);
-  gpio_set_pin_level(LCD_PORT_DATA, LCD_PIN_D5, data & 0x02);
-  gpio_set_pin_level(LCD_PORT_DATA, LCD_PIN_D6, data & 0x04);
-  gpio_set_pin_level(LCD_PORT_DATA, LCD_PIN_D7, data & 0x08);
+/* Maps a nibble onto the data pins, the pins being constants this folds into
+ * a few instructions.
+ */
+inline static uint8_t lcd_nibble_bits(uint8_t nibble) {
+  return ((nibble & 0x1) ? 1 << LCD_PIN_D4 : 0) |
+         ((nibble & 0x2) ? 1 << LCD_PIN_D5 : 0) |
+         ((nibble & 0x4) ? 1 << LCD_PIN_D6 : 0) |
+         ((nibble & 0x8) ? 1 << LCD_PIN_D7 : 0);
+}
 
-  gpio_set_pin_level(LCD_PORT_CONTROL, LCD_PIN_EN, 0);
-  _delay_us(40);
-  gpio_set_pin_level(LCD_PORT_CONTROL, LCD_PIN_EN, 1);
+inline static void lcd_nibble(uint8_t nibble) {
+  gpio_write_port_masked(LCD_PORT_DATA, LCD_DATA_MASK,
+                         lcd_nibble_bits(nibble));
+  lcd_en_set_high();
   _delay_us(1);
+  /* NOTE: The controller latches the nibble on the falling edge. */
+  lcd_en_set_low();
+  _delay_us(1);
+}
+
+#ifdef LCD_PIN_RW
+static void lcd_set_data_direction(uint8_t b_is_out) {
+  lcd_d4_set_direction(b_is_out);
+  lcd_d5_set_direction(b_is_out);
+  lcd_d6_set_direction(b_is_out);
+  lcd_d7_set_direction(b_is_out);
+}
+
+static void lcd_wait_ready(void) {
+  uint8_t b_is_busy = 1;
+  lcd_set_data_direction(0);
+  lcd_rs_set_low();
+  lcd_rw_set_high();
+  for (uint16_t polls = 0; b_is_busy && polls < LCD_BUSY_POLLS_MAX; ++polls) {
+    /* NOTE: The busy flag is D7 of the high nibble, the low nibble is read
+     *       and dropped to keep the nibbles in step.
+     */
+    lcd_en_set_high();
+    _delay_us(1);
+    b_is_busy = lcd_d7_is_high();
+    lcd_en_set_low();
+    _delay_us(1);
+    lcd_en_set_high();
+    _delay_us(1);
+    lcd_en_set_low();
+    _delay_us(1);
+  }
+  lcd_rw_set_low();
+  lcd_set_data_direction(1);
+}
+#endif
+
+inline static void lcd_write(uint8_t b_is_data, uint8_t data) {
+#ifdef LCD_PIN_RW
+  lcd_wait_ready();
+#endif
+  lcd_rs_set_level(b_is_data);
+  lcd_nibble(data >> 4);
+  lcd_nibble(data & 0x0F);
+#ifndef LCD_PIN_RW
+  _delay_us(40); // execution time of all instructions but clear and home
+  if (!b_is_data && (data == LCD_CLEAR_DISPLAY || data == LCD_RETURN_HOME)) {
+    _delay_ms(1.52);
+  }
+#endif
+}
+
+static void lcd_frame_clear(void) {
+  for (uint8_t row = 0; row < LCD_ROWS_NUM; ++row) {
+    for (uint8_t col = 0; col < LCD_COLS_NUM; ++col) {
+      g_frame[row][col] = ' ';
+    }
+    g_dirty_cols[row] = 0;
+  }
+  g_cursor_row = g_cursor_col = 0;
+}
+
+/* Sends the first run of changed cells, returns how many were sent. */
+static uint8_t lcd_frame_flush_run(void) {
+  for (uint8_t row = 0; row < LCD_ROWS_NUM; ++row) {
+    uint32_t dirty_cols = g_dirty_cols[row];
+    if (!dirty_cols) {
+      continue;
+    }
+    uint8_t col = 0;
+    while (!(dirty_cols & (1UL << col))) {
+      ++col;
+    }
+    lcd_command(g_line_commands[row] + col);
+    uint8_t count = 0;
+    for (; col < LCD_COLS_NUM && (dirty_cols & (1UL << col)); ++col) {
+      lcd_write(1, g_frame[row][col]);
+      ++count;
+    }
+    /* NOTE: Cells written meanwhile by an interrupt stay dirty. */
+    g_dirty_cols[row] &= ~(((1UL << count) - 1) << (col - count));
+    return count;
+  }
+  return 0;
 }
 
 lcd_status_t lcd_init(void) {
-  gpio_set_pin_direction(LCD_PORT_CONTROL, LCD_PIN_RS, true);
-  gpio_set_pin_direction(LCD_PORT_CONTROL, LCD_PIN_EN, true);
+  lcd_rs_set_direction(true);
+  lcd_en_set_direction(true);
+#ifdef LCD_PIN_RW
+  lcd_rw_set_direction(true);
+  lcd_rw_set_low();
+#endif
+  lcd_en_set_low();
 
-  gpio_set_pin_direction(LCD_PORT_DATA, LCD_PIN_D7, true);
-  gpio_set_pin_direction(LCD_PORT_DATA, LCD_PIN_D6, true);
-  gpio_set_pin_direction(LCD_PORT_DATA, LCD_PIN_D5, true);
-  gpio_set_pin_direction(LCD_PORT_DATA, LCD_PIN_D4, true);
+  lcd_d7_set_direction(true);
+  lcd_d6_set_direction(true);
+  lcd_d5_set_direction(true);
+  lcd_d4_set_direction(true);
 
   _delay_ms(40); // Wait for the LCD module to power up.
 
-  lcd_command(LCD_CLEAR_DISPLAY);
-  lcd_command(LCD_RETURN_HOME);
+  /* NOTE: Initializing by instruction, the controller may be in 8-bit mode
+   *       or half way through a byte in 4-bit mode. The busy flag cannot be
+   *       checked until the interface is set.
+   */
+  lcd_rs_set_low();
+  lcd_nibble(0x3);
+  _delay_ms(4.1);
+  lcd_nibble(0x3);
+  _delay_us(100);
+  lcd_nibble(0x3);
+  _delay_us(100);
+  lcd_nibble(0x2);
+  _delay_us(100);
 
   lcd_command(LCD_SET_4_BIT_FONT_5X10);
 
@@ -58,49 +182,64 @@ lcd_status_t lcd_init(void) {
   return LCD_OK;
 }
 
+lcd_status_t lcd_routine(void) {
+  lcd_frame_flush_run();
+  return LCD_OK;
+}
+
+lcd_status_t lcd_flush(void) {
+  while (lcd_frame_flush_run()) {
+  }
+  return LCD_OK;
+}
+
 lcd_status_t lcd_command(lcd_command_t command) {
-  gpio_set_pin_level(LCD_PORT_CONTROL, LCD_PIN_RS, 0);
-  lcd_data(command);
-  if (command == LCD_CLEAR_DISPLAY || command == LCD_RETURN_HOME) {
-    _delay_ms(1.52);
+  lcd_write(0, command);
+  if (command == LCD_CLEAR_DISPLAY) {
+    lcd_frame_clear();
   }
   return LCD_OK;
 }
 
 lcd_status_t lcd_char(char character) {
-  gpio_set_pin_level(LCD_PORT_CONTROL, LCD_PIN_RS, 1);
-  lcd_data(character);
+  if (g_cursor_row >= LCD_ROWS_NUM) {
+    return LCD_TEXT_OVERFLOW;
+  }
+  if (g_frame[g_cursor_row][g_cursor_col] != character) {
+    g_frame[g_cursor_row][g_cursor_col] = character;
+    g_dirty_cols[g_cursor_row] |= 1UL << g_cursor_col;
+  }
+  if (++g_cursor_col == LCD_COLS_NUM) {
+    g_cursor_col = 0;
+    ++g_cursor_row;
+  }
   return LCD_OK;
 }
 
 lcd_status_t lcd_str(char *str) {
-  gpio_set_pin_level(LCD_PORT_CONTROL, LCD_PIN_RS, 1);
   for (; *str; str++) {
-    lcd_data(*str);
+    if (lcd_char(*str) != LCD_OK) {
+      return LCD_TEXT_OVERFLOW;
+    }
   }
   return LCD_OK;
 }
 
-lcd_status_t lcd_locate_cursor(uint8_t row, uint8_t col) {
-  if (col >= LCD_ROWS_NUM) {
-    return LCD_ERROR;
+lcd_status_t lcd_str_P(const char *str_P) {
+  for (char c; (c = pgm_read_byte(str_P)); str_P++) {
+    if (lcd_char(c) != LCD_OK) {
+      return LCD_TEXT_OVERFLOW;
+    }
   }
-  switch (row) {
-  case 0:
-    lcd_command(LCD_SET_DDRAM_LINE_0 + col);
-    break;
-  case 1:
-    lcd_command(LCD_SET_DDRAM_LINE_1 + col);
-    break;
-  case 2:
-    lcd_command(LCD_SET_DDRAM_LINE_2 + col);
-    break;
-  case 3:
-    lcd_command(LCD_SET_DDRAM_LINE_3 + col);
-    break;
-  default:
+  return LCD_OK;
+}
+
+lcd_status_t lcd_locate_cursor(uint8_t row, uint8_t col) {
+  if (row >= LCD_ROWS_NUM || col >= LCD_COLS_NUM) {
     return LCD_ERROR;
   }
+  g_cursor_row = row;
+  g_cursor_col = col;
   return LCD_OK;
 }
 
@@ -136,13 +275,34 @@ lcd_status_t lcd_text(char *text, char padding) {
   return LCD_OK;
 }
 
+lcd_status_t lcd_text_P(const char *text_P, char padding) {
+  uint8_t row, col;
+  char c = pgm_read_byte(text_P);
+  for (row = 0; row < LCD_ROWS_NUM; ++row) {
+    lcd_locate_cursor(row, 0);
+    for (col = 0; col < LCD_COLS_NUM; ++col) {
+      if (c) {
+        lcd_char(c);
+        c = pgm_read_byte(++text_P);
+      } else {
+        lcd_char(padding);
+      }
+    }
+  }
+  if (c) {
+    return LCD_TEXT_OVERFLOW;
+  }
+  return LCD_OK;
+}
+
 lcd_status_t lcd_custom_char(uint8_t char_code, uint8_t dot_matrix[8]) {
   if (char_code >= LCD_CUSTOM_CHARS_NUM) {
     return LCD_ERROR;
   }
   lcd_command(LCD_SET_CGRAM + char_code * 8);
   for (uint8_t row = 0; row < 8; ++row) {
-    lcd_char(dot_matrix[row]);
+    lcd_write(1, dot_matrix[row]);
   }
+  /* NOTE: The next flush sets a DDRAM address before it sends data. */
   return LCD_OK;
 }
@@ -16,6 +16,16 @@
 #define LCD_PIN_RS GPIO_PIN_3
 #define LCD_PIN_EN GPIO_PIN_2
 
+/* Define the R/W pin to poll the busy flag rather than wait the worst-case
+ * execution time of every instruction, leave it undefined when R/W is tied
+ * to ground.
+ */
+// #define LCD_PIN_RW GPIO_PIN_1
+
+/* Busy flag polls before the controller is given up on, when it is missing.
+ */
+#define LCD_BUSY_POLLS_MAX 1000
+
 /* Define data pins. */
 #define LCD_PORT_DATA GPIO_PORT_B
 #define LCD_PIN_D4 GPIO_PIN_0
@@ -80,14 +90,22 @@ typedef enum : uint8_t {
   LCD_SET_DDRAM_LINE_3 = 0xD4,
 } lcd_command_t;
 
+/* NOTE: Characters are written to a frame buffer, lcd_routine() sends one
+ *       run of changed cells per call and lcd_flush() sends all of them.
+ *       Commands and custom chars go to the controller right away.
+ */
 lcd_status_t lcd_init(void);
+lcd_status_t lcd_routine(void);
+lcd_status_t lcd_flush(void);
 lcd_status_t lcd_char(char character);
 lcd_status_t lcd_str(char *str);
+lcd_status_t lcd_str_P(const char *str_P); /* str_P is in flash */
 lcd_status_t lcd_locate_cursor(uint8_t row, uint8_t col);
 lcd_status_t lcd_locate_char(uint8_t row, uint8_t col, char character);
 lcd_status_t lcd_locate_str(uint8_t row, uint8_t col, char *str);
 lcd_status_t lcd_command(lcd_command_t command);
 lcd_status_t lcd_text(char *text, char padding);
+lcd_status_t lcd_text_P(const char *text_P, char padding);
 lcd_status_t lcd_custom_char(uint8_t char_code, uint8_t dot_matrix[8]);
 
 #endif /* LCD_H */
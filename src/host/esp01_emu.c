@@ -0,0 +1,393 @@
+/**
+ * @file esp01_emu.c
+ * @brief Host stand-in of the ESP-01 AT firmware
+ *
+ * Speaks the AT dialect hal/esp01.c uses over a pty and bridges the server
+ * links to TCP sockets on localhost, so that the station can be driven by
+ * real clients, e.g. host/loadgen.
+ *
+ * Usage: esp01_emu [-l link] [-b baud] [-g gap ms] [-r boot ms]
+ *   -l  symlink created to the pty, e.g. /tmp/esp01
+ *   -b  line rate modelled towards the station, 0 for none, default 9600
+ *   -g  quiet line time before an unsolicited frame, default 20
+ *   -r  boot time before "ready" is sent and commands are taken, default 0
+ *
+ * NOTE: The station reads a frame until the line goes quiet and handles the
+ *       first +IPD of it, so +IPD, CONNECT and CLOSED are sent one at a time
+ *       once the line has been quiet for the gap.
+ */
+
+#define _XOPEN_SOURCE 700
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#define EMU_LINKS_NUM 5
+#define EMU_LINE_SIZE 256
+#define EMU_IPD_SIZE 1460
+#define EMU_EVENTS_NUM 16
+
+typedef enum {
+  EMU_STATE_BOOT,
+  EMU_STATE_COMMAND,
+  EMU_STATE_SEND_DATA,
+} emu_state_t;
+
+typedef struct {
+  int fd; /* -1 when closed */
+  uint64_t active_ms;
+} emu_link_t;
+
+static int g_master = -1;
+static int g_listener = -1;
+static emu_link_t g_links[EMU_LINKS_NUM];
+static emu_state_t g_state = EMU_STATE_BOOT;
+static int gb_echo = 1;
+static uint32_t g_timeout_s = 180;
+static char g_line[EMU_LINE_SIZE];
+static size_t g_line_len;
+static int g_send_id;
+static size_t g_send_left, g_send_len;
+static uint8_t g_send_buf[EMU_IPD_SIZE];
+static char g_events[EMU_EVENTS_NUM][16];
+static size_t g_events_head, g_events_num;
+
+static uint32_t g_baud = 9600;
+static uint64_t g_gap_ms = 20;
+static uint64_t g_line_free_ns; /* when the modelled line is idle again */
+static uint64_t g_quiet_since_ns;
+
+static uint64_t now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/* Wire time of n bytes, 10 bits each. */
+static uint64_t wire_ns(size_t n) {
+  return g_baud ? n * 10 * 1000000000ULL / g_baud : 0;
+}
+
+static void uart_write(const void *p_buf, size_t n) {
+  const uint8_t *p = p_buf;
+  /* NOTE: Bytes are paced, the station sees them arrive at the line rate.
+   *       The other way round the station paces itself, see usart_host.
+   */
+  for (size_t i = 0; i < n; ++i) {
+    uint64_t now = now_ns();
+    if (g_line_free_ns < now) {
+      g_line_free_ns = now;
+    }
+    g_line_free_ns += wire_ns(1);
+    g_quiet_since_ns = g_line_free_ns;
+    uint64_t due = g_line_free_ns;
+    struct timespec ts = {due / 1000000000ULL, due % 1000000000ULL};
+    while (g_baud &&
+           clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+      ;
+    while (write(g_master, p + i, 1) < 0 && errno == EINTR)
+      ;
+  }
+}
+
+static void uart_puts(const char *str) { uart_write(str, strlen(str)); }
+
+static void uart_printf(const char *format, ...) {
+  char str[EMU_LINE_SIZE];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(str, sizeof(str), format, args);
+  va_end(args);
+  uart_puts(str);
+}
+
+static void event_push(const char *format, int id) {
+  if (g_events_num == EMU_EVENTS_NUM) {
+    return;
+  }
+  snprintf(g_events[(g_events_head + g_events_num++) % EMU_EVENTS_NUM],
+           sizeof(g_events[0]), format, id);
+}
+
+static void link_close(int id, int b_notify) {
+  if (g_links[id].fd < 0) {
+    return;
+  }
+  close(g_links[id].fd);
+  g_links[id].fd = -1;
+  if (b_notify) {
+    event_push("%d,CLOSED\r\n", id);
+  }
+}
+
+static int server_open(int port) {
+  struct sockaddr_in addr = {.sin_family = AF_INET,
+                             .sin_port = htons(port),
+                             .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+  int one = 1;
+  g_listener = socket(AF_INET, SOCK_STREAM, 0);
+  if (g_listener < 0 ||
+      setsockopt(g_listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) ||
+      bind(g_listener, (struct sockaddr *)&addr, sizeof(addr)) ||
+      listen(g_listener, 16)) {
+    if (g_listener >= 0) {
+      close(g_listener);
+    }
+    g_listener = -1;
+    return -1;
+  }
+  fprintf(stderr, "esp01_emu: serving on 127.0.0.1:%d\n", port);
+  return 0;
+}
+
+static void server_close(void) {
+  for (int id = 0; id < EMU_LINKS_NUM; ++id) {
+    link_close(id, 0);
+  }
+  if (g_listener >= 0) {
+    close(g_listener);
+    g_listener = -1;
+  }
+}
+
+static void command(const char *cmd) {
+  int a, b;
+  if (gb_echo) {
+    uart_printf("%s\r\n", cmd);
+  }
+  if (!strcmp(cmd, "AT") || !strncmp(cmd, "AT+CWMODE=", 10) ||
+      !strncmp(cmd, "AT+CWSAP=", 9) || !strncmp(cmd, "AT+CIPMUX=", 10) ||
+      !strncmp(cmd, "AT+UART_CUR=", 12)) {
+    uart_puts("\r\nOK\r\n");
+  } else if (!strcmp(cmd, "ATE0") || !strcmp(cmd, "ATE1")) {
+    gb_echo = cmd[3] == '1';
+    uart_puts("\r\nOK\r\n");
+  } else if (!strcmp(cmd, "AT+GMR")) {
+    uart_puts("AT version:1.2.0.0(esp01_emu)\r\n\r\nOK\r\n");
+  } else if (sscanf(cmd, "AT+CIPSTO=%d", &a) == 1) {
+    g_timeout_s = a;
+    uart_puts("\r\nOK\r\n");
+  } else if (sscanf(cmd, "AT+CIPSERVER=%d,%d", &a, &b) == 2 && a == 1) {
+    uart_puts(g_listener >= 0 || !server_open(b) ? "\r\nOK\r\n"
+                                                 : "\r\nERROR\r\n");
+  } else if (!strcmp(cmd, "AT+CIPSERVER=0")) {
+    server_close();
+    uart_puts("\r\nOK\r\n");
+  } else if (sscanf(cmd, "AT+CIPCLOSE=%d", &a) == 1 && a >= 0 &&
+             a < EMU_LINKS_NUM && g_links[a].fd >= 0) {
+    link_close(a, 0);
+    uart_printf("%d,CLOSED\r\n\r\nOK\r\n", a);
+  } else if (sscanf(cmd, "AT+CIPSEND=%d,%d", &a, &b) == 2 && a >= 0 &&
+             a < EMU_LINKS_NUM && b > 0 && b <= EMU_IPD_SIZE) {
+    if (g_links[a].fd < 0) {
+      uart_puts("link is not valid\r\n\r\nERROR\r\n");
+      return;
+    }
+    g_send_id = a;
+    g_send_len = g_send_left = b;
+    g_state = EMU_STATE_SEND_DATA;
+    uart_puts("\r\nOK\r\n> ");
+  } else {
+    uart_puts("\r\nERROR\r\n");
+  }
+}
+
+static void uart_rx(uint8_t c) {
+  if (g_state == EMU_STATE_SEND_DATA) {
+    g_send_buf[g_send_len - g_send_left--] = c;
+    if (g_send_left == 0) {
+      g_state = EMU_STATE_COMMAND;
+      emu_link_t *p_link = &g_links[g_send_id];
+      if (p_link->fd < 0 ||
+          send(p_link->fd, g_send_buf, g_send_len, MSG_NOSIGNAL) < 0) {
+        uart_puts("\r\nSEND FAIL\r\n");
+        return;
+      }
+      p_link->active_ms = now_ns() / 1000000;
+      uart_printf("\r\nRecv %zu bytes\r\n\r\nSEND OK\r\n", g_send_len);
+    }
+    return;
+  }
+  if (c == '\n') {
+    /* NOTE: Empty lines, e.g. the CRLF after CIPSEND data, are ignored. */
+    if (g_line_len && g_line[g_line_len - 1] == '\r') {
+      g_line[--g_line_len] = '\0';
+    }
+    if (g_line_len) {
+      g_line[g_line_len] = '\0';
+      command(g_line);
+    }
+    g_line_len = 0;
+  } else if (g_line_len < EMU_LINE_SIZE - 1) {
+    g_line[g_line_len++] = c;
+  }
+}
+
+static void link_accept(void) {
+  int fd = accept(g_listener, NULL, NULL);
+  if (fd < 0) {
+    return;
+  }
+  for (int id = 0; id < EMU_LINKS_NUM; ++id) {
+    if (g_links[id].fd < 0) {
+      g_links[id].fd = fd;
+      g_links[id].active_ms = now_ns() / 1000000;
+      event_push("%d,CONNECT\r\n", id);
+      return;
+    }
+  }
+  close(fd); /* all links taken, as the module does */
+}
+
+/* Sends one unsolicited frame if the line is quiet, returns 1 if it did. */
+static int unsolicited(const struct pollfd *p_link_fds) {
+  if (g_state != EMU_STATE_COMMAND || g_line_len ||
+      now_ns() < g_quiet_since_ns + g_gap_ms * 1000000) {
+    return 0;
+  }
+  if (g_events_num) {
+    uart_puts(g_events[g_events_head]);
+    g_events_head = (g_events_head + 1) % EMU_EVENTS_NUM;
+    --g_events_num;
+    return 1;
+  }
+  static int next_id;
+  for (int i = 0; i < EMU_LINKS_NUM; ++i) {
+    int id = (next_id + i) % EMU_LINKS_NUM;
+    if (g_links[id].fd < 0 || !(p_link_fds[id].revents & (POLLIN | POLLHUP))) {
+      continue;
+    }
+    uint8_t buf[EMU_IPD_SIZE];
+    ssize_t len = recv(g_links[id].fd, buf, sizeof(buf), 0);
+    if (len <= 0) {
+      link_close(id, 1);
+      continue;
+    }
+    g_links[id].active_ms = now_ns() / 1000000;
+    next_id = id + 1;
+    uart_printf("\r\n+IPD,%d,%zd:", id, len);
+    uart_write(buf, len);
+    return 1;
+  }
+  return 0;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "usage: %s [-l link] [-b baud] [-g gap ms] [-r boot ms]\n",
+          name);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+  const char *link_path = NULL;
+  uint64_t boot_ms = 0;
+  for (int opt; (opt = getopt(argc, argv, "l:b:g:r:")) != -1;) {
+    switch (opt) {
+    case 'l':
+      link_path = optarg;
+      break;
+    case 'b':
+      g_baud = strtoul(optarg, NULL, 0);
+      break;
+    case 'g':
+      g_gap_ms = strtoull(optarg, NULL, 0);
+      break;
+    case 'r':
+      boot_ms = strtoull(optarg, NULL, 0);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+
+  struct termios tio;
+  g_master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (g_master < 0 || grantpt(g_master) || unlockpt(g_master) ||
+      tcgetattr(g_master, &tio)) {
+    perror("esp01_emu: pty");
+    return EXIT_FAILURE;
+  }
+  cfmakeraw(&tio);
+  tcsetattr(g_master, TCSANOW, &tio);
+  const char *slave_path = ptsname(g_master);
+  if (link_path != NULL) {
+    unlink(link_path);
+    if (symlink(slave_path, link_path)) {
+      perror("esp01_emu: symlink");
+      return EXIT_FAILURE;
+    }
+  }
+  printf("%s\n", link_path != NULL ? link_path : slave_path);
+  fflush(stdout);
+  signal(SIGPIPE, SIG_IGN);
+  for (int id = 0; id < EMU_LINKS_NUM; ++id) {
+    g_links[id].fd = -1;
+  }
+
+  uint64_t boot_ns = now_ns() + boot_ms * 1000000;
+  while (1) {
+    struct pollfd fds[2 + EMU_LINKS_NUM];
+    struct pollfd *p_link_fds = &fds[2];
+    fds[0] = (struct pollfd){.fd = g_master, .events = POLLIN};
+    fds[1] = (struct pollfd){.fd = g_listener, .events = POLLIN};
+    /* NOTE: Links are only watched once a frame could be sent, otherwise
+     *       their pending data would wake the loop up over and over.
+     */
+    int b_quiet = now_ns() >= g_quiet_since_ns + g_gap_ms * 1000000;
+    for (int id = 0; id < EMU_LINKS_NUM; ++id) {
+      p_link_fds[id] = (struct pollfd){
+          .fd = b_quiet ? g_links[id].fd : -1, .events = POLLIN};
+    }
+    if (poll(fds, 2 + EMU_LINKS_NUM, 1) < 0 && errno != EINTR) {
+      perror("esp01_emu: poll");
+      return EXIT_FAILURE;
+    }
+
+    if (g_state == EMU_STATE_BOOT) {
+      /* NOTE: Input while booting is lost, as on the module. */
+      uint8_t buf[64];
+      if ((fds[0].revents & POLLIN) && read(g_master, buf, sizeof(buf)) < 0) {
+        return EXIT_FAILURE;
+      }
+      if (now_ns() >= boot_ns) {
+        g_state = EMU_STATE_COMMAND;
+        uart_puts("\r\nready\r\n");
+      }
+      continue;
+    }
+
+    if (fds[0].revents & POLLIN) {
+      uint8_t buf[256];
+      ssize_t len = read(g_master, buf, sizeof(buf));
+      if (len > 0) {
+        g_quiet_since_ns = now_ns();
+        for (ssize_t i = 0; i < len; ++i) {
+          uart_rx(buf[i]);
+        }
+      }
+    }
+    if (g_listener >= 0 && (fds[1].revents & POLLIN)) {
+      link_accept();
+    }
+    uint64_t now_ms = now_ns() / 1000000;
+    for (int id = 0; id < EMU_LINKS_NUM; ++id) {
+      if (g_links[id].fd >= 0 && g_timeout_s &&
+          now_ms - g_links[id].active_ms > g_timeout_s * 1000ULL) {
+        link_close(id, 1);
+      }
+    }
+    unsolicited(p_link_fds);
+  }
+}
@@ -0,0 +1,43 @@
+/**
+ * @file pgmspace.h
+ * @brief Host stand-in of avr/pgmspace.h, flash strings are plain strings
+ */
+
+#ifndef HOST_PGMSPACE_H
+#define HOST_PGMSPACE_H
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+
+#define strcpy_P strcpy
+#define strstr_P strstr
+#define strcmp_P strcmp
+#define strchr_P strchr
+#define sscanf_P sscanf
+#define sprintf_P host_sprintf_P
+
+/* NOTE: %S prints a flash string on AVR but a wide string on the host. */
+static inline int host_sprintf_P(char *str, const char *format_P, ...) {
+  char format[256];
+  size_t i = 0;
+  for (; *format_P && i < sizeof(format) - 2; ++format_P) {
+    format[i++] = *format_P;
+    if (*format_P == '%' && (format_P[1] == '%' || format_P[1] == 'S')) {
+      format[i++] = *++format_P == 'S' ? 's' : '%';
+    }
+  }
+  format[i] = '\0';
+  va_list args;
+  va_start(args, format_P);
+  int len = vsprintf(str, format, args);
+  va_end(args);
+  return len;
+}
+
+#endif /* HOST_PGMSPACE_H */
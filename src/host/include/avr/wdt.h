@@ -0,0 +1,16 @@
+/**
+ * @file wdt.h
+ * @brief Host stand-in of avr/wdt.h, there is no watchdog
+ */
+
+#ifndef HOST_WDT_H
+#define HOST_WDT_H
+
+#define WDTO_15MS 0
+#define WDTO_2S 7
+
+#define wdt_enable(timeout) ((void)(timeout))
+#define wdt_disable() ((void)0)
+#define wdt_reset() ((void)0)
+
+#endif /* HOST_WDT_H */
@@ -0,0 +1,17 @@
+/**
+ * @file atomic.h
+ * @brief Host stand-in of util/atomic.h
+ *
+ * Host builds are single threaded and run interrupt handlers from the main
+ * loop only, so blocks are atomic as they are.
+ */
+
+#ifndef HOST_ATOMIC_H
+#define HOST_ATOMIC_H
+
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define ATOMIC_BLOCK(type)                                                     \
+  for (int host_atomic = 1; host_atomic; host_atomic = 0)
+
+#endif /* HOST_ATOMIC_H */
@@ -0,0 +1,20 @@
+/**
+ * @file crc16.h
+ * @brief Host stand-in of util/crc16.h
+ */
+
+#ifndef HOST_CRC16_H
+#define HOST_CRC16_H
+
+#include <stdint.h>
+
+/* Same polynomial 0x07 as the avr-libc routine. */
+static inline uint8_t _crc8_ccitt_update(uint8_t crc, uint8_t data) {
+  crc ^= data;
+  for (uint8_t i = 0; i < 8; ++i) {
+    crc = crc & 0x80 ? (crc << 1) ^ 0x07 : crc << 1;
+  }
+  return crc;
+}
+
+#endif /* HOST_CRC16_H */
@@ -0,0 +1,197 @@
+/**
+ * @file loadgen.c
+ * @brief Multi-client load generator for the station server
+ *
+ * Opens concurrent TCP clients to the server, e.g. behind host/esp01_emu,
+ * sends a request and waits for its response over and over, then reports
+ * the throughput and the latency percentiles.
+ *
+ * Usage: loadgen [-p port] [-c clients] [-t seconds] [-w timeout ms]
+ *                [-r request]
+ *
+ * A response is complete once its braces balance. Requests left without a
+ * response within the timeout are counted as lost and sent again.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOADGEN_LATENCIES_MAX 100000
+
+typedef struct {
+  pthread_t thread;
+  uint32_t *latencies_us;
+  size_t done, lost;
+  int b_failed;
+} loadgen_client_t;
+
+static int g_port = 12345;
+static int g_seconds = 10;
+static int g_timeout_ms = 5000;
+static const char *g_request = "{\"latest\": 1}";
+static uint64_t g_end_us;
+
+static uint64_t now_us(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+static int client_connect(void) {
+  struct sockaddr_in addr = {.sin_family = AF_INET,
+                             .sin_port = htons(g_port),
+                             .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+    close(fd);
+    fd = -1;
+  }
+  return fd;
+}
+
+/* Returns 1 on a complete response, 0 on timeout and -1 on a closed link. */
+static int client_receive(int fd) {
+  int depth = 0, b_started = 0;
+  uint64_t deadline_us = now_us() + g_timeout_ms * 1000ULL;
+  while (1) {
+    uint64_t now = now_us();
+    if (now >= deadline_us) {
+      return 0;
+    }
+    struct pollfd poll_fd = {.fd = fd, .events = POLLIN};
+    if (poll(&poll_fd, 1, (deadline_us - now + 999) / 1000) <= 0) {
+      continue;
+    }
+    char buf[256];
+    ssize_t len = recv(fd, buf, sizeof(buf), 0);
+    if (len <= 0) {
+      return -1;
+    }
+    for (ssize_t i = 0; i < len; ++i) {
+      if (buf[i] == '{') {
+        ++depth;
+        b_started = 1;
+      } else if (buf[i] == '}') {
+        --depth;
+      }
+    }
+    if (b_started && depth <= 0) {
+      return 1;
+    }
+  }
+}
+
+static void *client_run(void *p_arg) {
+  loadgen_client_t *p_client = p_arg;
+  /* NOTE: The server may still be starting up. */
+  int fd;
+  while ((fd = client_connect()) < 0 && now_us() < g_end_us) {
+    usleep(100000);
+  }
+  while (fd >= 0 && now_us() < g_end_us) {
+    uint64_t start_us = now_us();
+    if (send(fd, g_request, strlen(g_request), MSG_NOSIGNAL) < 0) {
+      break;
+    }
+    int status = client_receive(fd);
+    if (status < 0) {
+      /* NOTE: The server timeout or a full link table closed the link. */
+      close(fd);
+      fd = client_connect();
+      ++p_client->lost;
+    } else if (status == 0) {
+      ++p_client->lost;
+    } else if (p_client->done < LOADGEN_LATENCIES_MAX) {
+      p_client->latencies_us[p_client->done++] = now_us() - start_us;
+    }
+  }
+  if (fd < 0) {
+    p_client->b_failed = 1;
+  } else {
+    close(fd);
+  }
+  return NULL;
+}
+
+static int compare_u32(const void *p_a, const void *p_b) {
+  uint32_t a = *(const uint32_t *)p_a, b = *(const uint32_t *)p_b;
+  return (a > b) - (a < b);
+}
+
+int main(int argc, char **argv) {
+  int clients_num = 1;
+  for (int opt; (opt = getopt(argc, argv, "p:c:t:w:r:")) != -1;) {
+    switch (opt) {
+    case 'p':
+      g_port = atoi(optarg);
+      break;
+    case 'c':
+      clients_num = atoi(optarg);
+      break;
+    case 't':
+      g_seconds = atoi(optarg);
+      break;
+    case 'w':
+      g_timeout_ms = atoi(optarg);
+      break;
+    case 'r':
+      g_request = optarg;
+      break;
+    default:
+      fprintf(stderr,
+              "usage: %s [-p port] [-c clients] [-t seconds] "
+              "[-w timeout ms] [-r request]\n",
+              argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (clients_num < 1) {
+    clients_num = 1;
+  }
+
+  loadgen_client_t *clients = calloc(clients_num, sizeof(*clients));
+  uint64_t start_us = now_us();
+  g_end_us = start_us + g_seconds * 1000000ULL;
+  for (int i = 0; i < clients_num; ++i) {
+    clients[i].latencies_us =
+        malloc(LOADGEN_LATENCIES_MAX * sizeof(*clients[i].latencies_us));
+    pthread_create(&clients[i].thread, NULL, client_run, &clients[i]);
+  }
+
+  size_t done = 0, lost = 0, failed = 0;
+  for (int i = 0; i < clients_num; ++i) {
+    pthread_join(clients[i].thread, NULL);
+    done += clients[i].done;
+    lost += clients[i].lost;
+    failed += clients[i].b_failed;
+  }
+  double elapsed_s = (now_us() - start_us) / 1e6;
+
+  uint32_t *latencies_us = malloc((done + 1) * sizeof(*latencies_us));
+  size_t n = 0;
+  for (int i = 0; i < clients_num; ++i) {
+    memcpy(&latencies_us[n], clients[i].latencies_us,
+           clients[i].done * sizeof(*latencies_us));
+    n += clients[i].done;
+  }
+  qsort(latencies_us, n, sizeof(*latencies_us), compare_u32);
+
+  printf("clients %d seconds %.1f requests %zu lost %zu failed_clients %zu\n",
+         clients_num, elapsed_s, done, lost, failed);
+  printf("requests/s %.2f\n", done / elapsed_s);
+  if (n) {
+    printf("latency_ms p50 %.1f p99 %.1f max %.1f\n",
+           latencies_us[n / 2] / 1e3, latencies_us[(n * 99) / 100] / 1e3,
+           latencies_us[n - 1] / 1e3);
+  }
+  return failed == (size_t)clients_num ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,161 @@
+/**
+ * @file station_host.c
+ * @brief Host build of the station server for benchmarking
+ *
+ * Runs app/server.c, hal/esp01.c and app/storage.c unchanged against
+ * host/esp01_emu, with the storage in RAM and synthetic samples. The RTC,
+ * TWI, fault record and watchdog, alert rules, sensor health and profiler are
+ * stubbed out.
+ *
+ * Usage: station_host <tty of esp01_emu> [sample period in ms]
+ */
+
+#include "../app/alert.h"
+#include "../app/fault.h"
+#include "../app/server.h"
+#include "../app/storage.h"
+#include "../hal/ds1307.h"
+#include "../mcal/profile.h"
+#include "../mcal/timer.h"
+#include "../mcal/twi.h"
+#include "storage_host.h"
+#include "usart_host.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Longest the module is probed for before the server gives up. */
+#define STATION_HOST_BOOT_TIMEOUT_MS 5000
+
+/* Samples stored before the server starts, so that every index exists. */
+#define STATION_HOST_SEED_SAMPLES_NUM 64
+#define STATION_HOST_SAMPLE_PERIOD_MS 10000
+
+/* Seconds from 1970-01-01 to 2000-01-01, the epoch of RTC_toEpoch. */
+#define STATION_HOST_EPOCH_OFFSET_S 946684800UL
+
+/* -------- Stubs ---------- */
+timer_status_t timer_get_ms(uint32_t *p_ms) {
+  struct timespec now;
+  if (p_ms == NULL || clock_gettime(CLOCK_MONOTONIC, &now) != 0) {
+    return TIMER_ERROR;
+  }
+  *p_ms = now.tv_sec * 1000UL + now.tv_nsec / 1000000;
+  return TIMER_OK;
+}
+
+void TWI_init(const TWI_ConfigType *Config_Ptr) { (void)Config_Ptr; }
+
+void TWI_recover(void) {}
+
+uint8_t RTC_getTime(RTC_Time_t *p_time) {
+  (void)p_time;
+  return RTC_SUCCESS;
+}
+
+uint32_t RTC_toEpoch(const RTC_Time_t *p_time) {
+  (void)p_time;
+  return (uint32_t)(time(NULL) - STATION_HOST_EPOCH_OFFSET_S);
+}
+
+fault_status_t fault_get_record(fault_record_t *p_record) {
+  (void)p_record;
+  return FAULT_ERROR;
+}
+
+fault_status_t fault_feed(void) { return FAULT_OK; }
+
+weather_status_t weather_get_health(weather_sensor_t sensor,
+                                    weather_health_t *p_health) {
+  (void)sensor;
+  (void)p_health;
+  return Weather_Error;
+}
+
+alert_status_t alert_get_rule(uint8_t rule, alert_rule_t *p_rule) {
+  (void)rule;
+  (void)p_rule;
+  return ALERT_ERROR;
+}
+
+alert_status_t alert_set_rule(uint8_t rule, const alert_rule_t *p_rule) {
+  (void)rule;
+  (void)p_rule;
+  return ALERT_ERROR;
+}
+
+alert_status_t alert_get_event(uint8_t index, alert_event_t *p_event) {
+  (void)index;
+  (void)p_event;
+  return ALERT_ERROR;
+}
+
+profile_status_t profile_get_memory(profile_memory_t *p_memory) {
+  (void)p_memory;
+  return PROFILE_ERROR;
+}
+
+/* -------- Station ---------- */
+static server_status_t get_entry(uint16_t index, server_entry_t *p_entry) {
+  storage_stamp_t stamp;
+  if (storage_get_block(index, p_entry->data.as_array, &stamp) != STORAGE_OK) {
+    return SERVER_ERROR;
+  }
+  p_entry->seq = stamp.seq;
+  p_entry->timestamp = stamp.epoch;
+  return SERVER_OK;
+}
+
+static void enqueue_sample(uint32_t n) {
+  server_entry_data_t data;
+  data.as_struct.temperature = 20 + n % 10;
+  data.as_struct.humidity = 40 + n % 30;
+  data.as_struct.light = n % 256;
+  storage_enqueue_block(data.as_array);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s <tty> [sample period ms]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  uint32_t period_ms =
+      argc > 2 ? strtoul(argv[2], NULL, 0) : STATION_HOST_SAMPLE_PERIOD_MS;
+
+  if (usart_host_open(argv[1]) != USART_OK ||
+      storage_init(&g_storage_backend_host) != STORAGE_OK) {
+    fprintf(stderr, "cannot open %s\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+  uint32_t samples_num = 0;
+  while (samples_num < STATION_HOST_SEED_SAMPLES_NUM) {
+    enqueue_sample(samples_num++);
+  }
+
+  /* NOTE: As on the station, the module is probed until it booted. */
+  uint32_t now_ms = 0, start_ms = 0, sample_ms = 0;
+  timer_get_ms(&start_ms);
+  do {
+    timer_get_ms(&now_ms);
+  } while (server_ready() != SERVER_OK &&
+           now_ms - start_ms < STATION_HOST_BOOT_TIMEOUT_MS);
+  if (server_init() != SERVER_OK || server_run(get_entry) != SERVER_OK) {
+    fprintf(stderr, "server did not start\n");
+    return EXIT_FAILURE;
+  }
+  timer_get_ms(&now_ms);
+  fprintf(stderr, "serving after %lu ms\n",
+          (unsigned long)(now_ms - start_ms));
+
+  timer_get_ms(&sample_ms);
+  while (1) {
+    usart_host_routine(100);
+    timer_get_ms(&now_ms);
+    if (period_ms && now_ms - sample_ms >= period_ms) {
+      sample_ms = now_ms;
+      enqueue_sample(samples_num++);
+      server_notify();
+    }
+  }
+}
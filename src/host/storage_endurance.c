@@ -0,0 +1,488 @@
+/**
+ * @file storage_endurance.c
+ * @brief Host endurance benchmark of the storage engine.
+ *
+ * This file contains a harness that drives app/storage.c through millions of
+ * samples against a simulated EEPROM. The EEPROM counts the writes of every
+ * cell and cuts the power at random points of a write. After every cut the
+ * queue is recovered as on a reset and checked, as are random reads along
+ * the way, against a reference model of what was committed. A recovery that
+ * serves blocks the model does not hold fails the run like any mismatch,
+ * the queue is formatted to carry on without the mismatches cascading.
+ * It reports throughput, a wear histogram and map, and the lifetime the
+ * hottest cell projects to. Layouts are compared by building it with other
+ * STORAGE_* values, see the host_endurance target of the Makefile.
+ */
+
+#include "../app/fault.h"
+#include "../app/storage.h"
+#include "../mcal/timer.h"
+#include "../mcal/twi.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Default size matches the internal EEPROM left to the queue
+#ifndef ENDURANCE_SIZE
+#define ENDURANCE_SIZE 896
+#endif
+
+// Write cycles a cell is rated for, and the time a cell write takes
+#define ENDURANCE_CELL_CYCLES 100000UL
+#define ENDURANCE_CELL_WRITE_MS 8.5
+
+// Reference model, a power of two holding more blocks than the queue
+#define ENDURANCE_MODEL_SIZE (1UL << 17)
+
+#define ENDURANCE_HISTOGRAM_BINS 10
+#define ENDURANCE_MISMATCHES_SHOWN 10
+
+// Seconds from 2000-01-01 to 2024-05-10, the time the first sample is taken
+#define ENDURANCE_EPOCH_START 768614400UL
+
+_Static_assert(ENDURANCE_MODEL_SIZE > UINT16_MAX + STORAGE_BATCH_SIZE,
+               "ENDURANCE_MODEL_SIZE must hold a full queue and a batch");
+
+// A sample as the model expects to read it back
+typedef struct {
+    uint32_t epoch;
+    uint8_t data[STORAGE_BLOCK_DATA_SIZE];
+} model_block_t;
+
+// Simulated EEPROM, erased at start up
+static uint8_t g_memory[ENDURANCE_SIZE];
+static uint32_t g_cell_writes[ENDURANCE_SIZE];
+static uint64_t g_byte_writes = 0;
+
+// Unchanged bytes are skipped as eeprom_update_block does, unless set
+static bool gb_count_unchanged = false;
+
+// Byte writes left until the power is cut, mean distance between cuts
+static uint32_t g_cut_budget = 0;
+static uint32_t g_cut_mean = 0;
+static bool gb_power_cut = false;
+
+// Blocks a write completed since the model last looked
+static uint32_t g_blocks_written = 0;
+
+// Reference model: positions count blocks from the first sample on, the
+// storage sequence number is the position modulo the sequence space
+static model_block_t g_model[ENDURANCE_MODEL_SIZE];
+static uint64_t g_model_length = 0;
+static uint64_t g_model_committed = 0;
+
+// Blocks the queue is short of the model, the oldest slots a torn commit
+// cleared until the next commits overwrite them
+static uint16_t g_model_deficit = 0;
+
+static uint64_t g_mismatches = 0;
+
+// Simulated clock of the stubs below
+static uint32_t g_now_ms = 0;
+static uint32_t g_now_epoch = ENDURANCE_EPOCH_START;
+
+// Width of every data field in a packed record
+static const uint8_t g_data_bits[] = {
+    STORAGE_DATA_FIELDS(STORAGE_FIELD_BITS_ENTRY)
+};
+
+// -------- Stubs of the drivers storage.c uses ----------
+timer_status_t timer_get_ms(uint32_t *p_ms) {
+    *p_ms = g_now_ms;
+    return TIMER_OK;
+}
+
+void TWI_init(const TWI_ConfigType *Config_Ptr) { (void)Config_Ptr; }
+
+void TWI_recover(void) {}
+
+fault_status_t fault_feed(void) { return FAULT_OK; }
+
+uint8_t RTC_getTime(RTC_Time_t *p_time) {
+    (void)p_time;
+    return RTC_SUCCESS;
+}
+
+uint32_t RTC_toEpoch(const RTC_Time_t *p_time) {
+    (void)p_time;
+    return g_now_epoch;
+}
+
+// -------- Simulated EEPROM ----------
+// Function to draw the byte writes until the next power cut
+static void arm_power_cut(void) {
+    gb_power_cut = false;
+    g_cut_budget = g_cut_mean == 0 ? 0 :
+        1 + (uint32_t)(rand() % (2 * g_cut_mean));
+}
+
+// Function to check that a range lies within the memory
+static storage_status_t check_range(uint32_t address, uint16_t size) {
+    if (gb_power_cut || address > sizeof(g_memory) ||
+        size > sizeof(g_memory) - address) {
+        return STORAGE_ERROR;
+    }
+    return STORAGE_OK;
+}
+
+static storage_status_t endurance_read(uint32_t address, void *p_buf,
+    uint16_t size) {
+    if (check_range(address, size) != STORAGE_OK) {
+        return STORAGE_ERROR;
+    }
+    memcpy(p_buf, &g_memory[address], size);
+    return STORAGE_OK;
+}
+
+// Function to write one cell, false once the power is cut
+static bool write_cell(uint32_t address, uint8_t value) {
+    if (g_memory[address] == value && !gb_count_unchanged) {
+        return true;
+    }
+    ++g_cell_writes[address];
+    ++g_byte_writes;
+    if (g_cut_budget != 0 && --g_cut_budget == 0) {
+        // The cell being written when the power goes holds garbage
+        g_memory[address] = (uint8_t)rand();
+        gb_power_cut = true;
+        return false;
+    }
+    g_memory[address] = value;
+    return true;
+}
+
+static storage_status_t endurance_write(uint32_t address, const void *p_buf,
+    uint16_t size) {
+    if (check_range(address, size) != STORAGE_OK) {
+        return STORAGE_ERROR;
+    }
+    const uint8_t *p_byte = p_buf;
+    for (uint16_t i = 0; i < size; ++i) {
+        if (!write_cell(address + i, p_byte[i])) {
+            return STORAGE_ERROR;
+        }
+    }
+    // A block is committed once its commit byte is marked, which is written
+    // on its own after the block
+    if (size == 1 && *p_byte == STORAGE_COMMIT_MARK &&
+        (address - STORAGE_BASE_ADDRESS) % STORAGE_BLOCK_SIZE ==
+        STORAGE_BLOCK_SIZE - 1) {
+        ++g_blocks_written;
+    }
+    return STORAGE_OK;
+}
+
+static storage_status_t endurance_erase(uint32_t address, uint16_t size) {
+    if (check_range(address, size) != STORAGE_OK) {
+        return STORAGE_ERROR;
+    }
+    for (uint16_t i = 0; i < size; ++i) {
+        if (!write_cell(address + i, 0xFF)) {
+            return STORAGE_ERROR;
+        }
+    }
+    return STORAGE_OK;
+}
+
+static uint32_t endurance_size(void) { return sizeof(g_memory); }
+
+static const storage_backend_t g_endurance_backend = {
+    .read = endurance_read,
+    .write = endurance_write,
+    .erase = endurance_erase,
+    .size = endurance_size,
+};
+
+// -------- Reference model ----------
+// Function to get the block of the model at a position
+static model_block_t *model_block(uint64_t position) {
+    return &g_model[position % ENDURANCE_MODEL_SIZE];
+}
+
+// Function to report a difference between the queue and the model
+static void mismatch(const char *p_what, uint64_t position, uint16_t index) {
+    if (g_mismatches++ < ENDURANCE_MISMATCHES_SHOWN) {
+        fprintf(stderr, "mismatch: %s at position %" PRIu64
+            ", index %u\n", p_what, position, index);
+    }
+}
+
+// Function to account blocks the last commits wrote
+static void model_commit(void) {
+    if (g_blocks_written > 0) {
+        g_model_committed += g_blocks_written;
+        g_model_deficit = g_blocks_written >= g_model_deficit ? 0 :
+            g_model_deficit - g_blocks_written;
+        g_blocks_written = 0;
+    }
+}
+
+// Function to get the number of blocks the queue should hold
+static uint16_t model_expected_length(uint16_t capacity) {
+    // Staged blocks count on top of the committed ones, up to the capacity
+    uint64_t length = g_model_committed < capacity ? g_model_committed :
+        capacity;
+    length += g_model_length - g_model_committed - g_model_deficit;
+    return length < capacity ? length : capacity;
+}
+
+// Function to check one block of the queue against the model
+static void model_check_block(uint16_t index) {
+    uint8_t data[STORAGE_BLOCK_DATA_SIZE];
+    storage_stamp_t stamp;
+    uint64_t position = g_model_length - 1 - index;
+    if (storage_get_block(index, data, &stamp) != STORAGE_OK) {
+        mismatch("unreadable block", position, index);
+        return;
+    }
+    const model_block_t *p_expected = model_block(position);
+    if (stamp.seq != (position & STORAGE_SEQ_MASK)) {
+        mismatch("sequence number", position, index);
+    } else if (stamp.epoch != p_expected->epoch) {
+        mismatch("time", position, index);
+    } else if (memcmp(data, p_expected->data, sizeof(data)) != 0) {
+        mismatch("data", position, index);
+    }
+}
+
+// Function to check the length of the queue against the model
+static void model_check_length(uint16_t capacity) {
+    uint16_t length;
+    if (storage_get_length(&length) != STORAGE_OK ||
+        length != model_expected_length(capacity)) {
+        mismatch("length", g_model_length, 0);
+    }
+}
+
+// Function to restart after a power cut, as the firmware does on a reset,
+// false if the queue recovered does not match what was committed
+static bool reboot(uint16_t capacity, uint64_t *p_lost) {
+    model_commit();
+    arm_power_cut();
+    if (storage_init(&g_endurance_backend) != STORAGE_OK) {
+        mismatch("recovery", g_model_length, 0);
+        return true;
+    }
+    // The block being written survives when the cell the power tore ends up
+    // holding the value meant for it, the check below compares its data
+    uint8_t data[STORAGE_BLOCK_DATA_SIZE];
+    storage_stamp_t stamp;
+    if (g_model_length > g_model_committed &&
+        storage_get_block(0, data, &stamp) == STORAGE_OK &&
+        stamp.seq == (g_model_committed & STORAGE_SEQ_MASK)) {
+        ++g_model_committed;
+    }
+    *p_lost += g_model_length - g_model_committed;
+    g_model_length = g_model_committed;
+    // The slots a torn commit cleared held the oldest blocks of a full queue
+    uint16_t length, expected;
+    g_model_deficit = 0;
+    storage_get_length(&length);
+    expected = model_expected_length(capacity);
+    if (length < expected && expected - length <= STORAGE_BATCH_SIZE) {
+        g_model_deficit = expected - length;
+    }
+    uint64_t mismatches = g_mismatches;
+    model_check_length(capacity);
+    for (uint16_t index = 0; index < model_expected_length(capacity);
+         ++index) {
+        model_check_block(index);
+    }
+    if (g_mismatches == mismatches) {
+        return true;
+    }
+
+    // Carry on from an empty queue, as a client would have to. The format
+    // itself is not cut
+    *p_lost += model_expected_length(capacity);
+    g_model_length = g_model_committed = 0;
+    g_model_deficit = 0;
+    g_cut_budget = 0;
+    if (storage_format() != STORAGE_OK) {
+        mismatch("format", 0, 0);
+    }
+    arm_power_cut();
+    return false;
+}
+
+// Function to expect a sample as the packed record holds it
+static void model_append(const uint8_t *p_data) {
+    model_block_t *p_block = model_block(g_model_length++);
+    uint32_t time = g_now_epoch / STORAGE_TIME_RESOLUTION_S;
+    uint32_t time_max = 0xFFFFFFFFUL >> (32 - STORAGE_TIME_BITS);
+    p_block->epoch = (time > time_max ? time_max : time) *
+        STORAGE_TIME_RESOLUTION_S;
+    for (uint8_t i = 0; i < STORAGE_BLOCK_DATA_SIZE; ++i) {
+        uint8_t max = 0xFF >> (8 - g_data_bits[i]);
+        p_block->data[i] = p_data[i] > max ? max : p_data[i];
+    }
+}
+
+// -------- Report ----------
+static double get_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Function to print the wear histogram and map of the queue area
+static void report_wear(uint16_t capacity, uint64_t samples,
+    uint32_t period_s) {
+    uint32_t cells = (uint32_t)capacity * STORAGE_BLOCK_SIZE;
+    uint32_t max = 0, min = UINT32_MAX;
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < cells; ++i) {
+        max = g_cell_writes[i] > max ? g_cell_writes[i] : max;
+        min = g_cell_writes[i] < min ? g_cell_writes[i] : min;
+        sum += g_cell_writes[i];
+    }
+    printf("cell writes: min %" PRIu32 ", avg %.1f, max %" PRIu32 "\n",
+        min, (double)sum / cells, max);
+
+    // Histogram of the cells by their share of the hottest cell writes
+    uint32_t bins[ENDURANCE_HISTOGRAM_BINS] = {0};
+    for (uint32_t i = 0; i < cells; ++i) {
+        uint32_t bin = max == 0 ? 0 :
+            (uint64_t)g_cell_writes[i] * ENDURANCE_HISTOGRAM_BINS / (max + 1);
+        ++bins[bin];
+    }
+    printf("wear histogram (cells by writes):\n");
+    for (uint8_t bin = 0; bin < ENDURANCE_HISTOGRAM_BINS; ++bin) {
+        printf("  %10" PRIu64 " - %-10" PRIu64 " %6" PRIu32 " ",
+            (uint64_t)max * bin / ENDURANCE_HISTOGRAM_BINS,
+            (uint64_t)max * (bin + 1) / ENDURANCE_HISTOGRAM_BINS, bins[bin]);
+        for (uint32_t i = 0; i < bins[bin] * 50 / cells; ++i) {
+            putchar('#');
+        }
+        putchar('\n');
+    }
+
+    // Map of the writes by offset within a block, shows which fields wear
+    printf("wear map (avg writes by offset in block):\n ");
+    for (uint8_t offset = 0; offset < STORAGE_BLOCK_SIZE; ++offset) {
+        uint64_t offset_sum = 0;
+        for (uint16_t block = 0; block < capacity; ++block) {
+            offset_sum += g_cell_writes[block * STORAGE_BLOCK_SIZE + offset];
+        }
+        printf(" %.0f", (double)offset_sum / capacity);
+    }
+    putchar('\n');
+
+    // Every cell ages at the rate of the hottest one until it wears out
+    if (max > 0) {
+        double samples_to_wear_out = (double)ENDURANCE_CELL_CYCLES *
+            samples / max;
+        printf("lifetime: %.0f samples, %.1f years at one sample per %"
+            PRIu32 " s\n", samples_to_wear_out,
+            samples_to_wear_out * period_s / (365.25 * 24 * 3600), period_s);
+    }
+}
+
+static void usage(const char *p_name) {
+    fprintf(stderr,
+        "usage: %s [-n samples] [-c mean byte writes between power cuts, "
+        "0 for none]\n"
+        "       [-p sample period s] [-g reads per sample] [-s seed] "
+        "[-a count unchanged bytes]\n", p_name);
+}
+
+int main(int argc, char **argv) {
+    uint64_t samples = 1000000;
+    uint32_t period_s = 600;
+    uint32_t reads_per_sample = 4;
+    unsigned seed = 1;
+    int option;
+    g_cut_mean = 5000;
+    while ((option = getopt(argc, argv, "n:c:p:g:s:a")) != -1) {
+        switch (option) {
+        case 'n': samples = strtoull(optarg, NULL, 0); break;
+        case 'c': g_cut_mean = strtoul(optarg, NULL, 0); break;
+        case 'p': period_s = strtoul(optarg, NULL, 0); break;
+        case 'g': reads_per_sample = strtoul(optarg, NULL, 0); break;
+        case 's': seed = strtoul(optarg, NULL, 0); break;
+        case 'a': gb_count_unchanged = true; break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+    if (period_s == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    srand(seed);
+
+    memset(g_memory, 0xFF, sizeof(g_memory));
+    arm_power_cut();
+    uint16_t capacity;
+    if (storage_init(&g_endurance_backend) != STORAGE_OK ||
+        storage_get_capacity(&capacity) != STORAGE_OK) {
+        fprintf(stderr, "storage_init failed\n");
+        return 1;
+    }
+    printf("layout: %u B backend, %u B blocks, %u blocks, batch %u, "
+        "seq %u bits, time %u bits\n", ENDURANCE_SIZE, STORAGE_BLOCK_SIZE,
+        capacity, STORAGE_BATCH_SIZE, STORAGE_SEQ_BITS, STORAGE_TIME_BITS);
+
+    // Readings drift slowly as the weather does, which is what decides how
+    // many bytes an update actually writes
+    uint8_t data[STORAGE_BLOCK_DATA_SIZE] = {0};
+    uint64_t power_cuts = 0, corrupt_recoveries = 0, lost = 0, reads = 0;
+    double write_s = 0, read_s = 0;
+    for (uint64_t sample = 0; sample < samples; ++sample) {
+        g_now_ms += period_s * 1000;
+        g_now_epoch += period_s;
+        for (uint8_t i = 0; i < STORAGE_BLOCK_DATA_SIZE; ++i) {
+            data[i] += rand() % 3 - 1;
+        }
+
+        // As the main loop does: enqueue, then commit what waited too long.
+        // A cut after the block was staged loses it along with the batch
+        double start_s = get_seconds();
+        storage_status_t status = storage_enqueue_block(data);
+        if (status == STORAGE_OK || gb_power_cut) {
+            model_append(data);
+        }
+        if (status == STORAGE_OK) {
+            status = storage_routine();
+        }
+        write_s += get_seconds() - start_s;
+        if (gb_power_cut) {
+            ++power_cuts;
+            if (!reboot(capacity, &lost)) {
+                ++corrupt_recoveries;
+            }
+            continue;
+        }
+        if (status != STORAGE_OK) {
+            mismatch("write failed", g_model_length, 0);
+            continue;
+        }
+        model_commit();
+
+        start_s = get_seconds();
+        model_check_length(capacity);
+        uint16_t length = model_expected_length(capacity);
+        for (uint32_t i = 0; i < reads_per_sample && length > 0; ++i) {
+            model_check_block(rand() % length);
+        }
+        reads += reads_per_sample;
+        read_s += get_seconds() - start_s;
+    }
+
+    printf("samples: %" PRIu64 ", %.0f/s enqueued, %.0f/s read\n", samples,
+        samples / write_s, reads / read_s);
+    printf("power cuts: %" PRIu64 ", blocks lost: %" PRIu64
+        ", corrupt recoveries: %" PRIu64 "\n", power_cuts, lost,
+        corrupt_recoveries);
+    printf("byte writes: %.2f per sample, taking %.1f ms\n",
+        (double)g_byte_writes / samples,
+        g_byte_writes * ENDURANCE_CELL_WRITE_MS / samples);
+    report_wear(capacity, samples, period_s);
+    printf("mismatches: %" PRIu64 "\n", g_mismatches);
+
+    return g_mismatches == 0 ? 0 : 1;
+}
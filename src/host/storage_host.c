@@ -0,0 +1,66 @@
+/**
+ * @file storage_host.c
+ * @brief Host stand-in storage backend.
+ *
+ * This file contains definitions for a storage backend kept in RAM, so that
+ * app/storage.c can be built and exercised on a development machine.
+ */
+
+#include "storage_host.h"
+#include <stdint.h>
+#include <string.h>
+
+static uint8_t g_memory[STORAGE_HOST_SIZE];
+static uint8_t gb_initialized = 0;
+
+// Function to check that a range lies within the memory
+static storage_status_t check_range(uint32_t address, uint16_t size) {
+    if (!gb_initialized) {
+        memset(g_memory, 0xFF, sizeof(g_memory));
+        gb_initialized = 1;
+    }
+    if (address > sizeof(g_memory) || size > sizeof(g_memory) - address) {
+        return STORAGE_ERROR;
+    }
+    return STORAGE_OK;
+}
+
+static storage_status_t host_read(uint32_t address, void *p_buf,
+    uint16_t size) {
+    if (check_range(address, size) != STORAGE_OK) {
+        return STORAGE_ERROR;
+    }
+    memcpy(p_buf, &g_memory[address], size);
+    return STORAGE_OK;
+}
+
+static storage_status_t host_write(uint32_t address, const void *p_buf,
+    uint16_t size) {
+    if (check_range(address, size) != STORAGE_OK) {
+        return STORAGE_ERROR;
+    }
+    memcpy(&g_memory[address], p_buf, size);
+    return STORAGE_OK;
+}
+
+static storage_status_t host_erase(uint32_t address, uint16_t size) {
+    if (check_range(address, size) != STORAGE_OK) {
+        return STORAGE_ERROR;
+    }
+    memset(&g_memory[address], 0xFF, size);
+    return STORAGE_OK;
+}
+
+static uint32_t host_size(void) { return sizeof(g_memory); }
+
+const storage_backend_t g_storage_backend_host = {
+    .read = host_read,
+    .write = host_write,
+    .erase = host_erase,
+    .size = host_size,
+};
+
+uint8_t *storage_host_memory(void) {
+    check_range(0, 0);
+    return g_memory;
+}
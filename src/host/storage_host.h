@@ -0,0 +1,25 @@
+/**
+ * @file storage_host.h
+ * @brief Host stand-in storage backend.
+ *
+ * This file contains declarations for a storage backend kept in RAM, so that
+ * app/storage.c can be built and exercised on a development machine.
+ */
+
+#ifndef STORAGE_HOST_H
+#define STORAGE_HOST_H
+
+#include "../app/storage.h"
+
+// Default size matches the internal EEPROM
+#ifndef STORAGE_HOST_SIZE
+#define STORAGE_HOST_SIZE 1024
+#endif
+
+// RAM backed storage, erased at start up
+extern const storage_backend_t g_storage_backend_host;
+
+// Function to get the memory behind the backend, for inspection
+uint8_t *storage_host_memory(void);
+
+#endif /* STORAGE_HOST_H */
@@ -0,0 +1,130 @@
+/**
+ * @file usart_host.c
+ * @brief Host stand-in of the USART driver over a tty
+ */
+
+#include "usart_host.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+static int g_fd = -1;
+static void (*gp_rx_complete_isr)(void);
+static uint64_t g_byte_ns;    /* wire time of a byte, 0 for no pacing */
+static uint64_t g_tx_free_ns; /* when the line is idle again */
+
+static uint64_t usart_host_now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static usart_status_t usart_host_wait(int timeout_ms) {
+  struct pollfd poll_fd = {.fd = g_fd, .events = POLLIN};
+  int ready = poll(&poll_fd, 1, timeout_ms);
+  if (ready < 0 || (ready && !(poll_fd.revents & POLLIN))) {
+    return USART_ERROR;
+  }
+  return ready ? USART_OK : USART_RX_TIMEOUT;
+}
+
+usart_status_t usart_host_open(const char *path) {
+  if (path == NULL || (g_fd = open(path, O_RDWR | O_NOCTTY)) < 0) {
+    return USART_ERROR;
+  }
+  return USART_OK;
+}
+
+usart_status_t usart_host_routine(int timeout_ms) {
+  usart_status_t status = usart_host_wait(timeout_ms);
+  if (status == USART_OK && gp_rx_complete_isr != NULL) {
+    gp_rx_complete_isr();
+  }
+  return status;
+}
+
+usart_status_t usart_init(uint32_t baud_rate_bps, usart_parity_t parity,
+                          uint8_t b_two_stop_bits, uint8_t b_asynchronous,
+                          uint8_t b_double_speed, uint8_t b_multi_processor,
+                          uint8_t b_active_low_clock, uint8_t b_disable_tx,
+                          uint8_t b_disable_rx) {
+  (void)parity, (void)b_two_stop_bits, (void)b_asynchronous;
+  (void)b_double_speed, (void)b_multi_processor, (void)b_active_low_clock;
+  if (baud_rate_bps < USART_BAUD_RATE_MIN ||
+      baud_rate_bps > USART_BAUD_RATE_MAX ||
+      (b_disable_tx && b_disable_rx)) {
+    return USART_ERROR;
+  }
+  const char *baud_str = getenv("USART_HOST_BAUD");
+  if (baud_str != NULL) {
+    baud_rate_bps = strtoul(baud_str, NULL, 0);
+  }
+  /* NOTE: 8 data bits, a start and a stop bit. */
+  g_byte_ns = baud_rate_bps ? 10 * 1000000000ULL / baud_rate_bps : 0;
+  struct termios tio;
+  if (tcgetattr(g_fd, &tio) != 0) {
+    return USART_ERROR;
+  }
+  cfmakeraw(&tio);
+  if (tcsetattr(g_fd, TCSANOW, &tio) != 0) {
+    return USART_ERROR;
+  }
+  return USART_OK;
+}
+
+usart_status_t usart_configure_isr(void (*p_rx_complete_isr)(void),
+                                   void (*p_tx_complete_isr)(void),
+                                   void (*p_tx_ready_isr)(void)) {
+  (void)p_tx_complete_isr, (void)p_tx_ready_isr;
+  gp_rx_complete_isr = p_rx_complete_isr;
+  return USART_OK;
+}
+
+usart_status_t usart_get_flags(usart_flags_t *p_flags) {
+  if (p_flags == NULL) {
+    return USART_ERROR;
+  }
+  *p_flags = (usart_flags_t){0};
+  return USART_OK;
+}
+
+usart_status_t usart_get_counters(usart_counters_t *p_counters) {
+  if (p_counters == NULL) {
+    return USART_ERROR;
+  }
+  /* NOTE: The tty buffers, bytes are never overrun nor garbled. */
+  *p_counters = (usart_counters_t){0};
+  return USART_OK;
+}
+
+usart_status_t usart_hold_rx(uint8_t b_hold) {
+  (void)b_hold;
+  return USART_OK;
+}
+
+usart_status_t usart_tx(uint8_t data) {
+  if (g_byte_ns) {
+    uint64_t now = usart_host_now_ns();
+    g_tx_free_ns = (g_tx_free_ns > now ? g_tx_free_ns : now) + g_byte_ns;
+    struct timespec due = {g_tx_free_ns / 1000000000ULL,
+                           g_tx_free_ns % 1000000000ULL};
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL);
+  }
+  return write(g_fd, &data, 1) == 1 ? USART_OK : USART_ERROR;
+}
+
+usart_status_t usart_rx(uint8_t *p_data) {
+  if (p_data == NULL) {
+    return USART_ERROR;
+  }
+  usart_status_t status = usart_host_wait(USART_HOST_RX_TIMEOUT_MS);
+  if (status != USART_OK) {
+    return status;
+  }
+  return read(g_fd, p_data, 1) == 1 ? USART_OK : USART_ERROR;
+}
@@ -0,0 +1,32 @@
+/**
+ * @file usart_host.h
+ * @brief Host stand-in of the USART driver over a tty
+ *
+ * Implements mcal/usart.h on a tty, e.g. the pty of host/esp01_emu, so that
+ * hal/esp01.c and the app layer run unchanged on a development machine.
+ * Transmission is paced at the rate given to usart_init() as the AVR is, the
+ * environment variable USART_HOST_BAUD overrides it, 0 for no pacing.
+ */
+
+#ifndef USART_HOST_H
+#define USART_HOST_H
+
+#include "../mcal/usart.h"
+
+/* Silence that ends a usart_rx(), close to the USART_RX_TIMEOUT_TICKS_MAX
+ * polls of about 8 cycles each the AVR waits.
+ */
+#ifndef USART_HOST_RX_TIMEOUT_MS
+#define USART_HOST_RX_TIMEOUT_MS 8
+#endif
+
+/* Opens the tty, call before usart_init(). */
+usart_status_t usart_host_open(const char *path);
+
+/* Waits up to timeout_ms for a received byte and, if the RX complete
+ * interrupt is configured, runs its handler like the hardware would. Call
+ * from the main loop, handlers never run anywhere else.
+ */
+usart_status_t usart_host_routine(int timeout_ms);
+
+#endif /* USART_HOST_H */
@@ -1,61 +1,218 @@
+#include "app/alert.h"
+#include "app/display.h"
+#include "app/fault.h"
 #include "app/server.h"
 #include "app/storage.h"
+#include "app/storage_backend.h"
 #include "app/weather.h"
 #include "hal/lcd.h"
+#include "mcal/profile.h"
+#include "mcal/timer.h"
+#include <avr/pgmspace.h>
 #include <stdint.h>
-#include <util/delay.h>
 
 #define ROUTINE_FREQUENCY_MINUTES 10
+#define LIVE_FREQUENCY_SECONDS 5
+
+#if ROUTINE_FREQUENCY_MINUTES < 10
+#error "ROUTINE_FREQUENCY_MINUTES must be 10 at least"
+#endif
+
+#if ROUTINE_FREQUENCY_MINUTES * 60000UL != STORAGE_SAMPLE_PERIOD_MS
+#error "STORAGE_SAMPLE_PERIOD_MS must match ROUTINE_FREQUENCY_MINUTES"
+#endif
+
+#define ROUTINE_PERIOD_MS (ROUTINE_FREQUENCY_MINUTES * 60000UL)
+#define LIVE_PERIOD_MS (LIVE_FREQUENCY_SECONDS * 1000UL)
+#define BOOT_TIMEOUT_MS 5000UL // the ESP-01 answers AT within 1-2s of reset
+#define SYNC_MARGIN_MS 1000UL  // the RTC counts whole seconds
 
 void init(void);
+uint32_t get_routine_wait_ms(void);
 void routine(void);
+void live(void);
+
+// the millisecond count anchored on the RTC, see sync_time()
+static uint32_t g_sync_epoch, g_sync_ms;
+static uint8_t gb_synced = 0;
 
 int main(void) {
   init();
+  uint32_t now_ms, routine_ms, live_ms;
+  timer_get_ms(&now_ms);
+  routine_ms = now_ms - ROUTINE_PERIOD_MS + get_routine_wait_ms();
+  live_ms = now_ms;
   while (1) {
-    routine();
-#if ROUTINE_FREQUENCY_MINUTES < 10
-#error "ROUTINE_FREQUENCY_MINUTES must be 10 at least"
-#else
-    _delay_ms(ROUTINE_FREQUENCY_MINUTES * 60e3);
-#endif
+    timer_get_ms(&now_ms);
+    if (now_ms - routine_ms >= ROUTINE_PERIOD_MS) {
+      routine_ms += ROUTINE_PERIOD_MS;
+      routine();
+    }
+    if (now_ms - live_ms >= LIVE_PERIOD_MS) {
+      live_ms = now_ms;
+      live();
+    }
+    weather_routine();
+    storage_routine();
+    alert_routine();
+    fault_routine();
+    display_routine();
+    lcd_routine();
   }
 }
 
-void get_entry(uint8_t index, server_entry_t *p_entry) {
-  storage_get_block(index, p_entry->data.as_array, &p_entry->timestamp);
+server_status_t get_entry(uint16_t index, server_entry_t *p_entry) {
+  storage_stamp_t stamp;
+  if (storage_get_block(index, p_entry->data.as_array, &stamp) != STORAGE_OK) {
+    return SERVER_ERROR;
+  }
+  p_entry->seq = stamp.seq;
+  p_entry->timestamp = stamp.epoch;
+  return SERVER_OK;
 }
 
-void assert_ok(char *title, uint8_t call_return, uint8_t excepted_return) {
+uint8_t check_ok(const char *title_P, uint8_t call_return,
+                 uint8_t excepted_return) {
   if (call_return != excepted_return) {
-    lcd_locate_str(0, 0, "[FAILURE]");
-    lcd_locate_str(1, 0, title);
-    while (1) {
-      /* Polling */
-    }
+    // the station keeps running, the fault routine restarts what it can
+    display_status_P(title_P);
+    return 0;
   }
+  return 1;
+}
+
+void on_alert(const alert_event_t *p_event) {
+  server_push_alert(p_event); // subscribers learn of it within a sample
+  display_alert();
+}
+
+fault_status_t restart_server(void) {
+  server_kill(); // the module may not even answer anymore
+  fault_feed(); // each command may take up to ESP01_REPLY_TIMEOUT_MS
+  if (server_init() != SERVER_OK) {
+    return FAULT_ERROR;
+  }
+  fault_feed();
+  if (server_run(get_entry) != SERVER_OK) {
+    return FAULT_ERROR;
+  }
+  return FAULT_OK;
+}
+
+fault_status_t probe_server(void) {
+  return server_probe() == SERVER_OK ? FAULT_OK : FAULT_ERROR;
+}
+
+server_status_t wait_server_ready(void) {
+  uint32_t start_ms, now_ms;
+  timer_get_ms(&start_ms);
+  do {
+    fault_feed(); // a probe takes ESP01_PROBE_TIMEOUT_MS at most
+    if (server_ready() == SERVER_OK) {
+      return SERVER_OK;
+    }
+    timer_get_ms(&now_ms);
+  } while (now_ms - start_ms < BOOT_TIMEOUT_MS);
+  return SERVER_ERROR;
+}
+
+fault_status_t restart_bus(void) {
+  return storage_recover_bus() == STORAGE_OK ? FAULT_OK : FAULT_ERROR;
 }
 
 void init(void) {
+  timer_init();
+  PROFILE_INIT();
+  fault_init();
+  fault_register(FAULT_SUBSYSTEM_ESP01, restart_server, probe_server);
+  fault_register(FAULT_SUBSYSTEM_TWI, restart_bus, NULL);
   lcd_init();
-  lcd_text("init start..", ' ');
-  _delay_ms(2000); // for server_init
-  assert_ok("init:server_init", server_init(), SERVER_OK);
-  assert_ok("init:weather_init", weather_init(), Weather_OK);
-  assert_ok("init:storage_init", storage_init(), STORAGE_OK);
-  assert_ok("init:server_run", server_run(get_entry), SERVER_OK);
-  lcd_text("init end..", ' ');
+  lcd_text_P(PSTR("init start.."), ' ');
+  lcd_flush(); // the scheduler does not run before init ends
+  // the ESP-01 boots meanwhile, it is only waited for once the rest is up
+  check_ok(PSTR("init:weather_init"), weather_init(), Weather_OK);
+  // g_storage_backend_eeprom24 holds 32-256x more with an external chip
+  check_ok(PSTR("init:storage_init"),
+           storage_init(&g_storage_backend_internal), STORAGE_OK);
+  alert_init(on_alert); // stamps transitions with the time storage reads
+  display_init();
+  if (!check_ok(PSTR("init:server_ready"), wait_server_ready(), SERVER_OK) ||
+      !check_ok(PSTR("init:server"), server_init(), SERVER_OK)) {
+    fault_restart(FAULT_SUBSYSTEM_ESP01);
+    return;
+  }
+  fault_feed(); // each command may take up to ESP01_REPLY_TIMEOUT_MS
+  if (!check_ok(PSTR("init:server"), server_run(get_entry), SERVER_OK)) {
+    fault_restart(FAULT_SUBSYSTEM_ESP01);
+  }
+}
+
+// A reboot, e.g. by the fault module, resumes the sampling period of the
+// newest stored sample rather than sample again right away.
+uint32_t get_routine_wait_ms(void) {
+  server_entry_t entry;
+  uint32_t epoch;
+  if (get_entry(0, &entry) != SERVER_OK ||
+      storage_get_epoch(&epoch) != STORAGE_OK ||
+      epoch - entry.timestamp >= ROUTINE_PERIOD_MS / 1000) {
+    return 0; // nothing stored, or the period is over
+  }
+  return ROUTINE_PERIOD_MS - (epoch - entry.timestamp) * 1000;
+}
+
+// The millisecond count falls behind while the server holds interrupts
+// masked, which would stretch the sampling period and every timeout built on
+// it. It is moved forward to the RTC once a routine, to within a second.
+void sync_time(void) {
+  uint32_t epoch, now_ms;
+  if (storage_get_epoch(&epoch) != STORAGE_OK) {
+    return; // tried again on the next routine
+  }
+  timer_get_ms(&now_ms);
+  int32_t lag_ms = (epoch - g_sync_epoch) * 1000 - (now_ms - g_sync_ms);
+  if (!gb_synced || lag_ms < -(int32_t)SYNC_MARGIN_MS ||
+      lag_ms > (int32_t)ROUTINE_PERIOD_MS) {
+    // first read, or the RTC was set meanwhile
+    g_sync_epoch = epoch;
+    g_sync_ms = now_ms;
+    gb_synced = 1;
+    return;
+  }
+  if (lag_ms > (int32_t)SYNC_MARGIN_MS) {
+    timer_advance_ms(lag_ms - SYNC_MARGIN_MS); // never ahead of the RTC
+  }
 }
 
 void routine(void) {
   server_entry_data_t entry_data;
-  lcd_text("routine start..", ' ');
-  assert_ok("routine:weather_measures",
-            weather_measures(&entry_data.as_struct.temperature,
-                             &entry_data.as_struct.humidity,
-                             &entry_data.as_struct.light),
-            Weather_OK);
-  assert_ok("routine:storage_enqueue_block",
-            storage_enqueue_block(entry_data.as_array), STORAGE_OK);
-  lcd_text("routine end..", ' ');
+  sync_time();
+  if (weather_measures(&entry_data.as_struct.temperature,
+                       &entry_data.as_struct.humidity,
+                       &entry_data.as_struct.light) != Weather_OK) {
+    // retries are exhausted, skip the sample rather than halt the station
+    display_status_P(PSTR("sensor failure"));
+    return;
+  }
+  if (storage_enqueue_block(entry_data.as_array) != STORAGE_OK) {
+    // the RTC is read over TWI, free the bus and try once more
+    fault_restart(FAULT_SUBSYSTEM_TWI);
+    if (!check_ok(PSTR("routine:storage_enqueue_block"),
+                  storage_enqueue_block(entry_data.as_array), STORAGE_OK)) {
+      return;
+    }
+  }
+  server_notify(); // links dropped meanwhile are not worth halting for
+}
+
+void live(void) {
+  uint8_t b_subscribed;
+  server_entry_data_t entry_data;
+  if (server_get_subscribed(&b_subscribed) != SERVER_OK || !b_subscribed) {
+    return;
+  }
+  if (weather_measures(&entry_data.as_struct.temperature,
+                       &entry_data.as_struct.humidity,
+                       &entry_data.as_struct.light) == Weather_OK) {
+    server_push_live(&entry_data);
+  }
 }
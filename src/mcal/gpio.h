@@ -8,6 +8,7 @@
 #ifndef GPIO_H
 #define GPIO_H
 
+#include <avr/io.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -53,4 +54,87 @@ gpio_status_t gpio_get_pin_level(gpio_port_t port, gpio_pin_t pin,
 
 gpio_status_t gpio_set_pull_up(uint8_t b_is_disable);
 
+/* Compile-time Pin Binding */
+
+/* NOTE: Given constant ports and pins, as drivers configure them, the
+ *       switches below fold away and every access compiles to a single
+ *       SBI, CBI, SBIS/SBIC or IN/OUT instruction, with no call.
+ */
+#define GPIO_ALWAYS_INLINE static inline __attribute__((always_inline))
+
+GPIO_ALWAYS_INLINE volatile uint8_t *gpio_port_reg(gpio_port_t port) {
+  switch (port) {
+  case GPIO_PORT_A:
+    return &PORTA;
+  case GPIO_PORT_B:
+    return &PORTB;
+  case GPIO_PORT_C:
+    return &PORTC;
+  default:
+    return &PORTD;
+  }
+}
+
+GPIO_ALWAYS_INLINE volatile uint8_t *gpio_ddr_reg(gpio_port_t port) {
+  switch (port) {
+  case GPIO_PORT_A:
+    return &DDRA;
+  case GPIO_PORT_B:
+    return &DDRB;
+  case GPIO_PORT_C:
+    return &DDRC;
+  default:
+    return &DDRD;
+  }
+}
+
+GPIO_ALWAYS_INLINE volatile uint8_t *gpio_pin_reg(gpio_port_t port) {
+  switch (port) {
+  case GPIO_PORT_A:
+    return &PINA;
+  case GPIO_PORT_B:
+    return &PINB;
+  case GPIO_PORT_C:
+    return &PINC;
+  default:
+    return &PIND;
+  }
+}
+
+/* Writes the pins of mask in a single OUT, the other pins keep their levels.
+ */
+GPIO_ALWAYS_INLINE void gpio_write_port_masked(gpio_port_t port, uint8_t mask,
+                                               uint8_t data) {
+  volatile uint8_t *p_reg = gpio_port_reg(port);
+  *p_reg = (*p_reg & ~mask) | (data & mask);
+}
+
+/* Defines NAME_set_direction(), NAME_set_level(), NAME_set_high(),
+ * NAME_set_low() and NAME_is_high() bound to a pin at compile time.
+ */
+#define GPIO_PIN_DEFINE(NAME, PORT, PIN)                                       \
+  GPIO_ALWAYS_INLINE void NAME##_set_direction(uint8_t b_is_out) {             \
+    if (b_is_out) {                                                            \
+      *gpio_ddr_reg(PORT) |= 1 << (PIN);                                       \
+    } else {                                                                   \
+      *gpio_ddr_reg(PORT) &= ~(1 << (PIN));                                    \
+    }                                                                          \
+  }                                                                            \
+  GPIO_ALWAYS_INLINE void NAME##_set_high(void) {                              \
+    *gpio_port_reg(PORT) |= 1 << (PIN);                                        \
+  }                                                                            \
+  GPIO_ALWAYS_INLINE void NAME##_set_low(void) {                               \
+    *gpio_port_reg(PORT) &= ~(1 << (PIN));                                     \
+  }                                                                            \
+  GPIO_ALWAYS_INLINE void NAME##_set_level(uint8_t b_is_high) {                \
+    if (b_is_high) {                                                           \
+      NAME##_set_high();                                                       \
+    } else {                                                                   \
+      NAME##_set_low();                                                        \
+    }                                                                          \
+  }                                                                            \
+  GPIO_ALWAYS_INLINE uint8_t NAME##_is_high(void) {                            \
+    return !!(*gpio_pin_reg(PORT) & (1 << (PIN)));                             \
+  }
+
 #endif /* GPIO_H */
@@ -0,0 +1,126 @@
+/**
+ * @file profile.c
+ * @brief Cycle counting of named code sections on Timer/Counter1
+ */
+
+#include "profile.h"
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <util/atomic.h>
+
+/* Fill of SRAM no one has written since reset. */
+#define PROFILE_STACK_PAINT 0xC5
+
+/* Linker symbols, static data spans __data_start up to _end. */
+extern uint8_t __data_start, _end;
+
+void profile_paint_stack(void) __attribute__((naked, used, section(".init3")));
+
+/* NOTE: Runs before .data and .bss are set up, and with nothing pushed yet,
+ *       so everything between the static data and the stack pointer is free.
+ */
+void profile_paint_stack(void) {
+  for (uint8_t *p = &_end; p < (uint8_t *)(uintptr_t)SP; ++p) {
+    *p = PROFILE_STACK_PAINT;
+  }
+}
+
+profile_status_t profile_get_memory(profile_memory_t *p_memory) {
+  if (p_memory == NULL) {
+    return PROFILE_ERROR;
+  }
+  /* NOTE: The stack grows down from RAMEND towards the static data, the
+   *       paint left over right after the static data is what it never used.
+   */
+  const uint8_t *p = &_end;
+  while (p <= (const uint8_t *)RAMEND && *p == PROFILE_STACK_PAINT) {
+    ++p;
+  }
+  p_memory->static_bytes = &_end - &__data_start;
+  p_memory->stack_unused_bytes = p - &_end;
+  return PROFILE_OK;
+}
+
+#ifdef PROFILE_ENABLE
+
+/* High word of the cycle count, Timer1 overflows every 65536 cycles. */
+static volatile uint16_t g_overflows;
+static profile_entry_t g_entries[PROFILE_SECTIONS_NUM];
+
+profile_status_t profile_init(void) {
+  profile_reset();
+  TCCR1A = 0;
+  TCNT1 = 0;
+  TCCR1B = 1 << CS10; // normal mode, no prescaler
+  TIMSK |= 1 << TOIE1;
+  sei();
+  return PROFILE_OK;
+}
+
+profile_status_t profile_get_cycles(uint32_t *p_cycles) {
+  if (p_cycles == NULL) {
+    return PROFILE_ERROR;
+  }
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    uint16_t low = TCNT1;
+    uint16_t high = g_overflows;
+    /* NOTE: An overflow pending while masked is not counted yet, a low count
+     *       tells that it happened before TCNT1 was read.
+     */
+    if ((TIFR & 1 << TOV1) && low < UINT16_MAX / 2) {
+      ++high;
+    }
+    *p_cycles = (uint32_t)high << 16 | low;
+  }
+  return PROFILE_OK;
+}
+
+profile_status_t profile_record(profile_section_t section, uint32_t start) {
+  uint32_t now;
+  if (section >= PROFILE_SECTIONS_NUM ||
+      profile_get_cycles(&now) != PROFILE_OK) {
+    return PROFILE_ERROR;
+  }
+  uint32_t cycles = now - start;
+  profile_entry_t *p_entry = &g_entries[section];
+  /* NOTE: Entries are read from the server interrupt. */
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    if (p_entry->count == 0 || cycles < p_entry->min) {
+      p_entry->min = cycles;
+    }
+    if (cycles > p_entry->max) {
+      p_entry->max = cycles;
+    }
+    p_entry->total += cycles;
+    ++p_entry->count;
+  }
+  return PROFILE_OK;
+}
+
+profile_status_t profile_get_entry(profile_section_t section,
+                                   profile_entry_t *p_entry) {
+  if (section >= PROFILE_SECTIONS_NUM || p_entry == NULL) {
+    return PROFILE_ERROR;
+  }
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { *p_entry = g_entries[section]; }
+  return PROFILE_OK;
+}
+
+profile_status_t profile_reset(void) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    for (uint8_t i = 0; i < PROFILE_SECTIONS_NUM; ++i) {
+      g_entries[i] = (profile_entry_t){0};
+    }
+  }
+  return PROFILE_OK;
+}
+
+void profile_scope_end(profile_scope_t *p_scope) {
+  profile_record(p_scope->section, p_scope->start);
+}
+
+ISR(TIMER1_OVF_vect) { ++g_overflows; }
+
+#endif /* PROFILE_ENABLE */
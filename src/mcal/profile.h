@@ -0,0 +1,80 @@
+/**
+ * @file profile.h
+ * @brief Cycle counting of named code sections on Timer/Counter1
+ *
+ * Builds with PROFILE_ENABLE defined, e.g. make EXTRA_CFLAGS=-DPROFILE_ENABLE,
+ * run Timer1 free at the CPU clock and record count, minimum, maximum and total
+ * cycles of every section. Otherwise the macros compile to nothing and Timer1
+ * is left free.
+ * The SRAM usage probe is always built, it costs a pass over free SRAM at
+ * start up.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+typedef enum : uint8_t {
+  PROFILE_OK = 0,
+  PROFILE_ERROR = 1,
+} profile_status_t;
+
+/* NOTE: Names are in the same order, keep them in sync. */
+typedef enum : uint8_t {
+  PROFILE_DHT11_READ,
+  PROFILE_STORAGE_ENQUEUE,
+  PROFILE_SECTIONS_NUM,
+} profile_section_t;
+
+#define PROFILE_SECTION_NAME_SIZE 22
+#define PROFILE_SECTION_NAMES {"dht11_read", "storage_enqueue_block"}
+
+/* NOTE: Cycles include interrupts taken inside the section. A section must
+ *       not run with interrupts masked for 65536 cycles or more, the Timer1
+ *       overflows it misses are lost. That rules out the server, which runs
+ *       in the USART RX interrupt for a whole request and its reply.
+ */
+typedef struct {
+  uint32_t count;
+  uint32_t min, max;
+  uint64_t total;
+} profile_entry_t;
+
+typedef struct {
+  uint32_t start;
+  profile_section_t section;
+} profile_scope_t;
+
+typedef struct {
+  uint16_t static_bytes;       /* .data, .bss and .noinit */
+  uint16_t stack_unused_bytes; /* never reached by the stack since reset */
+} profile_memory_t;
+
+profile_status_t profile_init(void);
+
+/* CPU cycles since profile_init(), wraps around every 2^32 cycles. */
+profile_status_t profile_get_cycles(uint32_t *p_cycles);
+
+profile_status_t profile_record(profile_section_t section, uint32_t start);
+profile_status_t profile_get_entry(profile_section_t section,
+                                   profile_entry_t *p_entry);
+profile_status_t profile_reset(void);
+profile_status_t profile_get_memory(profile_memory_t *p_memory);
+
+/* Records from here to the end of the enclosing scope, whatever path leaves
+ * it, e.g. PROFILE_SCOPE(PROFILE_DHT11_READ); first thing in a function.
+ */
+#ifdef PROFILE_ENABLE
+void profile_scope_end(profile_scope_t *p_scope);
+#define PROFILE_INIT() profile_init()
+#define PROFILE_SCOPE(SECTION)                                                 \
+  profile_scope_t profile_scope                                                \
+      __attribute__((cleanup(profile_scope_end))) = {0, (SECTION)};            \
+  profile_get_cycles(&profile_scope.start)
+#else
+#define PROFILE_INIT() ((void)0)
+#define PROFILE_SCOPE(SECTION) ((void)0)
+#endif
+
+#endif /* PROFILE_H */
@@ -0,0 +1,45 @@
+/**
+ * @file timer.c
+ * @brief Driver of Timer/Counter0 as a millisecond time base
+ */
+
+#include "timer.h"
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <util/atomic.h>
+
+static volatile uint32_t g_ms;
+
+timer_status_t timer_init(void) {
+  TCNT0 = 0;
+  OCR0 = TIMER_TICKS_PER_MS - 1;
+  TCCR0 = 1 << WGM01 | 1 << CS01 | 1 << CS00;
+  TIMSK |= 1 << OCIE0;
+  sei();
+  return TIMER_OK;
+}
+
+timer_status_t timer_get_ms(uint32_t *p_ms) {
+  if (p_ms == NULL) {
+    return TIMER_ERROR;
+  }
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { *p_ms = g_ms; }
+  return TIMER_OK;
+}
+
+timer_status_t timer_advance_ms(uint32_t ms) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { g_ms += ms; }
+  return TIMER_OK;
+}
+
+timer_status_t timer_get_ticks(uint8_t *p_ticks) {
+  if (p_ticks == NULL) {
+    return TIMER_ERROR;
+  }
+  *p_ticks = TCNT0;
+  return TIMER_OK;
+}
+
+ISR(TIMER0_COMP_vect) { ++g_ms; }
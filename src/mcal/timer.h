@@ -0,0 +1,36 @@
+/**
+ * @file timer.h
+ * @brief Driver of Timer/Counter0 as a millisecond time base
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+/* Timer0 in CTC mode with prescaler 64 compares every 1ms. */
+#define TIMER_PRESCALER 64
+#define TIMER_TICKS_PER_MS ((uint8_t)(F_CPU / TIMER_PRESCALER / 1000))
+#define TIMER_US_PER_TICK (1000 / TIMER_TICKS_PER_MS)
+
+/* NOTE: Only one compare is held pending while interrupts are masked, e.g.
+ *       while the server answers a request in the USART RX interrupt, so the
+ *       count falls behind by about the time spent masked beyond 1ms. Whoever
+ *       owns a real time clock moves it forward with timer_advance_ms().
+ */
+
+typedef enum : uint8_t {
+  TIMER_OK = 0,
+  TIMER_ERROR = 1,
+} timer_status_t;
+
+timer_status_t timer_init(void);
+timer_status_t timer_get_ms(uint32_t *p_ms);
+
+/* Moves the count forward by milliseconds it missed, never backwards. */
+timer_status_t timer_advance_ms(uint32_t ms);
+
+/* Ticks into the current millisecond, 0 to TIMER_TICKS_PER_MS - 1. */
+timer_status_t timer_get_ticks(uint8_t *p_ticks);
+
+#endif /* TIMER_H */
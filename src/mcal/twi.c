@@ -11,16 +11,28 @@
  *******************************************************************************/
 
 #include<avr/io.h>
+#include<util/delay.h>
 #include"twi.h"
 
 #define BIT_IS_CLEAR(REG,BIT) ( !(REG & (1<<BIT)) )
 
+/* SCL and SDA pins of port C */
+#define TWI_SCL_PIN 0
+#define TWI_SDA_PIN 1
+
+/* a slave stuck mid byte releases SDA within 9 clocks */
+#define TWI_RECOVER_CLOCKS 9
+
+/* configuration TWI_recover initializes TWI again with */
+static TWI_ConfigType g_config;
+
 /*
  * Description :
  * a function to initialize TWI
  */
 void TWI_init(const TWI_ConfigType* Config_Ptr)
 {
+	g_config = *Config_Ptr;
 	/* set bit rate */
 	TWBR = (((F_CPU / Config_Ptr->bit_rate) / 1000) - 16) / 2;
 	/* set address for slave mode */
@@ -112,3 +124,37 @@ uint8_t TWI_getStatus()
 	/* return the 5 bits status */
 	return (TWSR & 0xF8);
 }
+
+/*
+ * Description:
+ * a function to free the bus from a slave holding SDA low and initialize
+ * TWI again with the configuration given to TWI_init
+ */
+void TWI_recover(void)
+{
+	if(g_config.bit_rate == 0)
+	{
+		/* never initialized */
+		return;
+	}
+	/* disable TWI so the pins are driven as GPIO, released lines are pulled
+	 * up externally and driven lines are pulled low */
+	TWCR = 0;
+	PORTC &= ~((1<<TWI_SCL_PIN) | (1<<TWI_SDA_PIN));
+	DDRC &= ~((1<<TWI_SCL_PIN) | (1<<TWI_SDA_PIN));
+	/* clock SCL until the slave releases SDA */
+	for(uint8_t i = 0; i < TWI_RECOVER_CLOCKS && BIT_IS_CLEAR(PINC, TWI_SDA_PIN); i++)
+	{
+		DDRC |= (1<<TWI_SCL_PIN);
+		_delay_us(5);
+		DDRC &= ~(1<<TWI_SCL_PIN);
+		_delay_us(5);
+	}
+	/* stop condition: SDA rises while SCL is high */
+	DDRC |= (1<<TWI_SDA_PIN);
+	_delay_us(5);
+	DDRC &= ~(1<<TWI_SDA_PIN);
+	_delay_us(5);
+	/* initialize TWI again */
+	TWI_init(&g_config);
+}
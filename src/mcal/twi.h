@@ -77,4 +77,11 @@ uint8_t TWI_readByteWithNACK();
  * a function to get the status of the last operation
  */
 uint8_t TWI_getStatus();
+
+/*
+ * Description:
+ * a function to free the bus from a slave holding SDA low and initialize
+ * TWI again with the configuration given to TWI_init
+ */
+void TWI_recover(void);
 #endif /* TWI_H_ */
@@ -6,13 +6,34 @@
  */
 
 #include "usart.h"
+#include "gpio.h"
 #include <avr/interrupt.h>
 #include <avr/io.h>
 #include <stdint.h>
+#include <util/atomic.h>
 
 static void (*gp_rx_complete_isr)(void);
 static void (*gp_tx_complete_isr)(void);
 static void (*gp_tx_ready_isr)(void);
+static usart_counters_t g_counters;
+
+#ifdef USART_FLOW_CONTROL
+GPIO_PIN_DEFINE(usart_rts, USART_RTS_PORT, USART_RTS_PIN)
+GPIO_PIN_DEFINE(usart_cts, USART_CTS_PORT, USART_CTS_PIN)
+
+static volatile uint8_t gb_rx_held;
+
+/* NOTE: Bytes are taken while usart_rx() polls, or while the RX interrupt
+ *       reads them and nobody holds the link. The peer stops within a byte,
+ *       which the two-byte receive buffer absorbs.
+ */
+static void usart_update_rts(uint8_t b_polling) {
+  usart_rts_set_level(
+      !(b_polling || (gp_rx_complete_isr != NULL && !gb_rx_held)));
+}
+#else
+static inline void usart_update_rts(uint8_t b_polling) { (void)b_polling; }
+#endif
 
 usart_status_t usart_init(uint32_t baud_rate_bps, usart_parity_t parity,
                           uint8_t b_two_stop_bits, uint8_t b_asynchronous,
@@ -49,6 +70,12 @@ usart_status_t usart_init(uint32_t baud_rate_bps, usart_parity_t parity,
           !!(parity & 1) << UPM0 | !!b_two_stop_bits << USBS | 1 << UCSZ1 |
           1 << UCSZ0 | !!b_active_low_clock << UCPOL;
 
+#ifdef USART_FLOW_CONTROL
+  usart_rts_set_direction(1);
+  usart_cts_set_direction(0);
+  usart_update_rts(0);
+#endif
+
   return USART_OK;
 }
 
@@ -63,6 +90,7 @@ usart_status_t usart_configure_isr(void (*p_rx_complete_isr)(void),
   UCSRB |= (p_rx_complete_isr != NULL) << RXCIE |
            (p_tx_complete_isr != NULL) << TXCIE |
            (p_tx_ready_isr != NULL) << UDRIE;
+  usart_update_rts(0);
 
   if (p_rx_complete_isr != NULL || p_tx_complete_isr != NULL ||
       p_tx_ready_isr != NULL) {
@@ -80,7 +108,34 @@ usart_status_t usart_get_flags(usart_flags_t *p_flags) {
   return USART_OK;
 }
 
+usart_status_t usart_get_counters(usart_counters_t *p_counters) {
+  if (p_counters == NULL) {
+    return USART_ERROR;
+  }
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { *p_counters = g_counters; }
+  return USART_OK;
+}
+
+usart_status_t usart_hold_rx(uint8_t b_hold) {
+#ifdef USART_FLOW_CONTROL
+  gb_rx_held = !!b_hold;
+  usart_update_rts(0);
+#else
+  (void)b_hold;
+#endif
+  return USART_OK;
+}
+
 usart_status_t usart_tx(uint8_t data) {
+#ifdef USART_FLOW_CONTROL
+  uint16_t timeout_ticks = 0;
+  while (usart_cts_is_high()) {
+    /* polling to clear to send, a peer stuck busy is given up on */
+    if (timeout_ticks++ == USART_RX_TIMEOUT_TICKS_MAX) {
+      return USART_ERROR;
+    }
+  }
+#endif
   while (!(UCSRA & (1 << UDRE))) {
     /* polling to data ready */
   }
@@ -92,14 +147,25 @@ usart_status_t usart_rx(uint8_t *p_data) {
   if (p_data == NULL) {
     return USART_ERROR;
   }
+  usart_update_rts(1);
+  uint8_t flags;
   uint16_t timeout_ticks = 0;
-  while (!(UCSRA & (1 << RXC))) {
+  while (!((flags = UCSRA) & (1 << RXC))) {
     /* polling to receive complete */
     if (timeout_ticks++ == USART_RX_TIMEOUT_TICKS_MAX) {
+      usart_update_rts(0);
       return USART_RX_TIMEOUT;
     }
   }
+  /* NOTE: The error flags belong to the byte in UDR, read them first. */
+  if (flags & (1 << DOR)) {
+    ++g_counters.overruns;
+  }
+  if (flags & (1 << FE)) {
+    ++g_counters.frame_errors;
+  }
   *p_data = UDR;
+  usart_update_rts(0);
   return USART_OK;
 }
 
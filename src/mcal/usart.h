@@ -15,6 +15,17 @@
 #define USART_BAUD_RATE_MIN (uint32_t)2400
 #define USART_RX_TIMEOUT_TICKS_MAX ((uint16_t)(F_CPU / 1e3))
 
+/* Define to pace the link with RTS/CTS on GPIO pins, the peer must have flow
+ * control enabled too. RTS is driven low while bytes are taken, CTS is polled
+ * before every byte sent. The ESP-01 does not break its RTS and CTS out, so
+ * it is left undefined unless the module is wired for it.
+ */
+// #define USART_FLOW_CONTROL
+#define USART_RTS_PORT GPIO_PORT_D
+#define USART_RTS_PIN GPIO_PIN_4
+#define USART_CTS_PORT GPIO_PORT_D
+#define USART_CTS_PIN GPIO_PIN_5
+
 typedef enum : uint8_t {
   USART_OK = 0,
   USART_ERROR = 1,
@@ -32,6 +43,12 @@ typedef struct {
       b_frame_error : 1, b_data_overrun : 1, b_parity_error : 1, unused : 2;
 } usart_flags_t;
 
+/* Counted by usart_rx() from the flags of every byte received, they wrap. */
+typedef struct {
+  uint16_t overruns;     /* bytes lost as the previous were not read in time */
+  uint16_t frame_errors; /* bytes with no stop bit, e.g. on a baud mismatch */
+} usart_counters_t;
+
 usart_status_t usart_init(uint32_t baud_rate_bps, usart_parity_t parity,
                           uint8_t b_two_stop_bits, uint8_t b_asynchronous,
                           uint8_t b_double_speed, uint8_t b_multi_processor,
@@ -41,6 +58,14 @@ usart_status_t usart_configure_isr(void (*p_rx_complete_isr)(void),
                                    void (*p_tx_complete_isr)(void),
                                    void (*p_tx_ready_isr)(void));
 usart_status_t usart_get_flags(usart_flags_t *p_flags);
+usart_status_t usart_get_counters(usart_counters_t *p_counters);
+
+/* Tells the peer to stop sending while b_hold, e.g. while a received message
+ * is handled, usart_rx() still takes bytes meanwhile. Does nothing without
+ * USART_FLOW_CONTROL.
+ */
+usart_status_t usart_hold_rx(uint8_t b_hold);
+
 usart_status_t usart_tx(uint8_t data);
 usart_status_t usart_rx(uint8_t *p_data);
 